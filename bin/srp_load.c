@@ -233,6 +233,7 @@ static void help(int status, const char *argv0)
 		printf("\t-o <op>, --operation=<op> Operation to perform\n");
 		printf("\t\t's' Set (default)\n");
 		printf("\t\t'd' Delete\n");
+		printf("\t\tLine starting with 'set' or 'del' overrides operation\n");
 		printf("\t-d <ds>, --datastore=<ds> Datastore (Default is 'candidate')\n");
 		printf("\t-p <sr-path>, --current-path=<sr-path> Current sysrepo path\n");
 	}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include <faux/faux.h>
 #include <faux/argv.h>
@@ -19,6 +20,7 @@ int main(int argc, char **argv)
 	faux_argv_t *args = faux_argv_new();
 	pline_t *pline = NULL;
 	pline_opts_t opts;
+	srp_sink_t *sink = NULL;
 
 	if (argc < 2)
 		return -1;
@@ -41,7 +43,9 @@ int main(int argc, char **argv)
 	pline = pline_parse(sess, args, &opts);
 	faux_argv_free(args);
 	pline_debug(pline);
-	pline_print_completions(pline, BOOL_TRUE, PT_COMPL_ALL, BOOL_FALSE);
+	sink = srp_sink_new(STDOUT_FILENO);
+	pline_print_completions(pline, BOOL_TRUE, PT_COMPL_ALL, BOOL_FALSE, sink);
+	srp_sink_free(sink);
 	pline_free(pline);
 
 	ret = 0;
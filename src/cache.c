@@ -0,0 +1,408 @@
+/** @file cache.c
+ * @brief Shared cache of rendered 'show' output.
+ *
+ * Rendering of large running configuration takes much more time than
+ * sending it. Many sessions show the same data with the same settings. So
+ * the rendered output is stored within files in cache directory. The files
+ * are shared by all sessions. The cache entry is keyed by settings, path and
+ * value of running datastore change counter. The counter is stored within
+ * cache directory too. The counter only grows. A single session of all
+ * sessions sharing the directory subscribes to changes of running datastore
+ * and increments counter on change. The subscriber is elected by exclusive
+ * lock of lock file. Other sessions try to take the lock before each use of
+ * cache so the next session takes over when the subscriber exits. The
+ * counter is incremented on take over because nobody could track changes
+ * before. The key contains sysrepo schema content-id too so schema change
+ * (new module, changed klish:hidden extension) invalidates the cache. The
+ * cached output is sent to output by sendfile().
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <syslog.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+
+#include <sysrepo.h>
+
+#include "klish_plugin_sysrepo.h"
+
+#define SRP_CACHE_COUNTER "counter"
+#define SRP_CACHE_LOCK "subscriber.lock"
+#define SRP_CACHE_MAGIC "SRPCACHE1"
+#define SRP_CACHE_HEADER_MAX 64
+
+
+struct srp_cache_s {
+	char *dir;
+	sr_conn_ctx_t *conn;
+	sr_session_ctx_t *sess; // Own session to subscribe to running changes
+	sr_subscription_ctx_t *sub; // Not NULL for elected subscriber only
+	int lock_fd; // Lock file. It's locked by elected subscriber
+};
+
+
+// Atomically change counter. The 'inc' is 0 to get current value only
+static bool_t srp_cache_counter(srp_cache_t *cache, unsigned long long inc,
+	unsigned long long *counter)
+{
+	char *fn = NULL;
+	int fd = -1;
+	char buf[32] = {};
+	ssize_t r = 0;
+	unsigned long long val = 0;
+	bool_t ret = BOOL_FALSE;
+
+	fn = faux_str_sprintf("%s/%s", cache->dir, SRP_CACHE_COUNTER);
+	fd = open(fn, O_RDWR | O_CREAT, 0644);
+	faux_str_free(fn);
+	if (fd < 0)
+		return BOOL_FALSE;
+	if (flock(fd, inc ? LOCK_EX : LOCK_SH) < 0)
+		goto err;
+
+	r = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (r < 0)
+		goto err;
+	buf[r] = '\0';
+	val = strtoull(buf, NULL, 10);
+
+	if (inc) {
+		int len = 0;
+		val += inc;
+		len = snprintf(buf, sizeof(buf), "%020llu\n", val);
+		if (pwrite(fd, buf, len, 0) != len)
+			goto err;
+	}
+	if (counter)
+		*counter = val;
+
+	ret = BOOL_TRUE;
+err:
+	close(fd); // Releases lock
+
+	return ret;
+}
+
+
+static int srp_cache_change_cb(sr_session_ctx_t *session, uint32_t sub_id,
+	const char *module_name, const char *xpath, sr_event_t event,
+	uint32_t request_id, void *private_data)
+{
+	srp_cache_t *cache = (srp_cache_t *)private_data;
+
+	if (!srp_cache_counter(cache, 1, NULL))
+		syslog(LOG_WARNING, "Can't change show cache counter");
+
+	session = session;
+	sub_id = sub_id;
+	module_name = module_name;
+	xpath = xpath;
+	event = event;
+	request_id = request_id;
+
+	return SR_ERR_OK;
+}
+
+
+// Become a subscriber if nobody else is. Returns BOOL_FALSE if changes
+// are not tracked by anybody.
+static bool_t srp_cache_elect(srp_cache_t *cache)
+{
+	const struct ly_ctx *ctx = NULL;
+	const struct lys_module *module = NULL;
+	uint32_t i = 0;
+
+	if (cache->sub)
+		return BOOL_TRUE;
+	// Another session is a subscriber
+	if (flock(cache->lock_fd, LOCK_EX | LOCK_NB) < 0)
+		return (EWOULDBLOCK == errno) ? BOOL_TRUE : BOOL_FALSE;
+
+	// Subscribe to all modules with data
+	ctx = sr_acquire_context(cache->conn);
+	while ((module = ly_ctx_get_module_iter(ctx, &i))) {
+		if (!module->implemented || !module->compiled ||
+			!module->compiled->data)
+			continue;
+		// Modules without configuration data can fail. It's ok
+		sr_module_change_subscribe(cache->sess, module->name, NULL,
+			srp_cache_change_cb, cache, 0,
+			SR_SUBSCR_DONE_ONLY | SR_SUBSCR_PASSIVE, &cache->sub);
+	}
+	sr_release_context(cache->conn);
+	if (!cache->sub) {
+		syslog(LOG_WARNING, "Can't subscribe to running changes");
+		flock(cache->lock_fd, LOCK_UN);
+		return BOOL_FALSE;
+	}
+
+	// Nobody could track changes before subscription
+	if (!srp_cache_counter(cache, 1, NULL)) {
+		sr_unsubscribe(cache->sub);
+		cache->sub = NULL;
+		flock(cache->lock_fd, LOCK_UN);
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+srp_cache_t *srp_cache_new(sr_conn_ctx_t *conn, const char *dir)
+{
+	srp_cache_t *cache = NULL;
+	char *fn = NULL;
+
+	assert(conn);
+	assert(dir);
+	if (!conn || !dir)
+		return NULL;
+
+	cache = faux_zmalloc(sizeof(*cache));
+	assert(cache);
+	if (!cache)
+		return NULL;
+	cache->dir = faux_str_dup(dir);
+	cache->conn = conn;
+
+	fn = faux_str_sprintf("%s/%s", dir, SRP_CACHE_LOCK);
+	cache->lock_fd = open(fn, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	faux_str_free(fn);
+	if (cache->lock_fd < 0) {
+		syslog(LOG_WARNING, "Can't use show cache dir \"%s\"", dir);
+		srp_cache_free(cache);
+		return NULL;
+	}
+
+	if (sr_session_start(conn, SR_DS_RUNNING, &cache->sess) != SR_ERR_OK) {
+		srp_cache_free(cache);
+		return NULL;
+	}
+	if (!srp_cache_elect(cache)) {
+		syslog(LOG_WARNING, "Can't use show cache dir \"%s\"", dir);
+		srp_cache_free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+
+void srp_cache_free(srp_cache_t *cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->sub)
+		sr_unsubscribe(cache->sub);
+	if (cache->sess)
+		sr_session_stop(cache->sess);
+	// Releases lock so another session takes over
+	if (cache->lock_fd >= 0)
+		close(cache->lock_fd);
+	faux_str_free(cache->dir);
+	faux_free(cache);
+}
+
+
+// Key contains everything that affects rendered output. The schema is
+// identified by sysrepo content-id.
+static char *srp_cache_key(srp_cache_t *cache, const char *xpath,
+	const pline_opts_t *opts)
+{
+	const char *match = opts->show_match ? opts->show_match : "";
+	const char *except = opts->show_except ? opts->show_except : "";
+
+	// Strings are prefixed by length to make key unambiguous
+	return faux_str_sprintf("%u:%c%c%d%d%d%d%d%u%d%d%d%d:%u:%d:%d:%u:"
+		"%zu:%s:%zu:%s:%s", sr_get_content_id(cache->conn),
+		opts->begin_bracket, opts->end_bracket,
+		opts->show_brackets, opts->show_semicolons,
+		opts->first_key_w_stmt, opts->keys_w_stmt, opts->colorize,
+		opts->indent, opts->default_keys, opts->show_default_keys,
+		opts->hide_passwords, opts->oneliners, opts->show_depth,
+		opts->show_display, opts->show_count, opts->show_last,
+		strlen(match), match, strlen(except), except,
+		xpath ? xpath : "");
+}
+
+
+// FNV-1a hash of key is a name of cache file
+static char *srp_cache_fn(srp_cache_t *cache, const char *key)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	const unsigned char *p = (const unsigned char *)key;
+
+	for (; *p; p++) {
+		hash ^= *p;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return faux_str_sprintf("%s/show-%016llx", cache->dir, hash);
+}
+
+
+static bool_t srp_cache_sendfile(int out_fd, int in_fd, off_t offset)
+{
+	struct stat st = {};
+
+	if (fstat(in_fd, &st) < 0)
+		return BOOL_FALSE;
+
+	while (offset < st.st_size) {
+		ssize_t r = sendfile(out_fd, in_fd, &offset, st.st_size - offset);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return BOOL_FALSE;
+		}
+		if (0 == r)
+			break;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Check header of cache file. Returns offset of data or -1
+static off_t srp_cache_check(int fd, const char *key,
+	unsigned long long counter)
+{
+	char buf[SRP_CACHE_HEADER_MAX + 1] = {};
+	char *eol = NULL;
+	ssize_t r = 0;
+	unsigned long long file_counter = 0;
+	size_t key_len = 0;
+	size_t header_len = 0;
+	char *file_key = NULL;
+	off_t offset = -1;
+
+	r = pread(fd, buf, SRP_CACHE_HEADER_MAX, 0);
+	if (r <= 0)
+		return -1;
+	buf[r] = '\0';
+	if (!(eol = strchr(buf, '\n')))
+		return -1;
+	*eol = '\0';
+	header_len = eol - buf + 1;
+	if (sscanf(buf, SRP_CACHE_MAGIC " %llu %zu",
+		&file_counter, &key_len) != 2)
+		return -1;
+	if ((file_counter != counter) || (key_len != strlen(key)))
+		return -1;
+
+	// Compare full key to avoid hash collisions
+	file_key = faux_malloc(key_len + 1);
+	assert(file_key);
+	if ((pread(fd, file_key, key_len + 1, header_len) == (ssize_t)(key_len + 1)) &&
+		(memcmp(file_key, key, key_len) == 0) &&
+		(file_key[key_len] == '\n'))
+		offset = header_len + key_len + 1;
+	faux_free(file_key);
+
+	return offset;
+}
+
+
+// Returns BOOL_TRUE if request is processed. The 'failed' is set if
+// output can't be rendered. The error is reported already.
+bool_t srp_cache_show(srp_cache_t *cache, sr_session_ctx_t *sess,
+	const char *xpath, size_t xpath_depth, pline_opts_t *opts, int fd,
+	bool_t *failed)
+{
+	char *key = NULL;
+	char *fn = NULL;
+	char *tmp_fn = NULL;
+	char *header = NULL;
+	unsigned long long counter = 0;
+	int cache_fd = -1;
+	off_t offset = -1;
+	srp_sink_t *sink = NULL;
+	bool_t ret = BOOL_FALSE;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	if (failed)
+		*failed = BOOL_FALSE;
+	// Paged output has next page hint that is not cached
+	if ((opts->show_first != 0) || (opts->show_skip != 0) ||
+		opts->show_from || opts->show_to)
+		return BOOL_FALSE;
+	// Changes of state data are not tracked by counter
+	if (opts->show_state)
+		return BOOL_FALSE;
+
+	// Take over subscription if subscriber is gone. Counter must be got
+	// before data to don't cache outdated data
+	if (!srp_cache_elect(cache))
+		return BOOL_FALSE;
+	if (!srp_cache_counter(cache, 0, &counter))
+		return BOOL_FALSE;
+	key = srp_cache_key(cache, xpath, opts);
+	fn = srp_cache_fn(cache, key);
+
+	// Hit
+	cache_fd = open(fn, O_RDONLY);
+	if (cache_fd >= 0) {
+		offset = srp_cache_check(cache_fd, key, counter);
+		if (offset >= 0) {
+			srp_cache_sendfile(fd, cache_fd, offset);
+			ret = BOOL_TRUE;
+			goto err;
+		}
+		close(cache_fd);
+		cache_fd = -1;
+	}
+
+	// Miss. Render to temporary file then replace cache file atomically
+	tmp_fn = faux_str_sprintf("%s/.show-XXXXXX", cache->dir);
+	cache_fd = mkstemp(tmp_fn);
+	if (cache_fd < 0)
+		goto err;
+	header = faux_str_sprintf(SRP_CACHE_MAGIC " %llu %zu\n%s\n",
+		counter, strlen(key), key);
+	offset = (off_t)strlen(header);
+	sink = srp_sink_new(cache_fd);
+	srp_sink_puts(sink, header);
+	// Error is already reported. Don't try to render once more
+	if (!show_xpath(sess, xpath, xpath_depth, opts, sink)) {
+		unlink(tmp_fn);
+		if (failed)
+			*failed = BOOL_TRUE;
+		ret = BOOL_TRUE;
+		goto err;
+	}
+	// Can't write cache file. Render without cache
+	if (!srp_sink_flush(sink)) {
+		unlink(tmp_fn);
+		goto err;
+	}
+	fchmod(cache_fd, 0644);
+	if (rename(tmp_fn, fn) < 0)
+		unlink(tmp_fn);
+	srp_cache_sendfile(fd, cache_fd, offset);
+	ret = BOOL_TRUE;
+
+err:
+	srp_sink_free(sink);
+	if (cache_fd >= 0)
+		close(cache_fd);
+	faux_str_free(header);
+	faux_str_free(tmp_fn);
+	faux_str_free(fn);
+	faux_str_free(key);
+
+	return ret;
+}
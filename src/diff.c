@@ -0,0 +1,607 @@
+/** @file diff.c
+ * @brief Diff of large data trees.
+ *
+ * The lyd_diff_siblings() compares every node of two trees and it's slow
+ * for large configurations where only a few nodes are changed. So the
+ * content hash of each subtree is computed bottom-up. Then trees are
+ * compared top-down and identical subtrees are removed from both trees.
+ * The lyd_diff_siblings() gets small trees with changed nodes and their
+ * ancestors only. So the result is the same 'yang:operation' annotated
+ * diff as for full trees.
+ *
+ * The hash only selects candidates for pruning. The equal hashes are
+ * confirmed by full comparison of subtrees so hash collision can't hide a
+ * change.
+ *
+ * The hash is stored within 'priv' field of data node. The fetched trees
+ * are private copies so nobody else uses the field.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+
+#include <sysrepo.h>
+
+#include "klish_plugin_sysrepo.h"
+
+// Prefix of LYB snapshot file in diff source
+#define SRP_DIFF_FILE_PREFIX "file:"
+
+
+static uint64_t srp_diff_mix(uint64_t hash, uint64_t value)
+{
+	hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+
+	return hash;
+}
+
+
+// FNV-1a
+static uint64_t srp_diff_str_hash(const char *str)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const unsigned char *p = (const unsigned char *)str;
+
+	if (!str)
+		return 0;
+	for (; *p; p++) {
+		hash ^= *p;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+
+// Hash of node's content. The order of children doesn't matter except
+// the entries of user-ordered lists and leaf-lists.
+static uint64_t srp_diff_hash_tree(struct lyd_node *node)
+{
+	uint64_t hash = 0;
+	uint64_t sum = 0;
+	uint64_t pos = 0;
+	struct lyd_node *iter = NULL;
+
+	// Trees belong to the same context so schema is compared by pointer
+	hash = srp_diff_mix(hash, (uintptr_t)node->schema);
+	if (node->schema->nodetype & LYD_NODE_TERM)
+		hash = srp_diff_mix(hash, srp_diff_str_hash(lyd_get_value(node)));
+	if (node->flags & LYD_DEFAULT)
+		hash = srp_diff_mix(hash, 1);
+
+	LY_LIST_FOR(lyd_child(node), iter) {
+		uint64_t child_hash = srp_diff_hash_tree(iter);
+		if (iter->schema->flags & LYS_ORDBYUSER)
+			child_hash = srp_diff_mix(child_hash, pos++);
+		sum += child_hash;
+	}
+	hash = srp_diff_mix(hash, sum);
+	node->priv = (void *)(uintptr_t)hash;
+
+	return hash;
+}
+
+
+static void srp_diff_hash_siblings(struct lyd_node *first)
+{
+	struct lyd_node *iter = NULL;
+
+	LY_LIST_FOR(first, iter)
+		srp_diff_hash_tree(iter);
+}
+
+
+static bool_t srp_diff_is_equal(const struct lyd_node *first,
+	const struct lyd_node *second)
+{
+	if (first->priv != second->priv)
+		return BOOL_FALSE;
+	// Equal hashes can be a collision. The pruned subtree is lost for diff
+	// and for incremental commit so the match is confirmed by comparison.
+	// It's still cheaper than lyd_diff_siblings() for the same subtree.
+	if (lyd_compare_single(first, second, LYD_COMPARE_FULL_RECURSION |
+		LYD_COMPARE_DEFAULTS) != LY_SUCCESS)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// Entry of user-ordered list is kept to don't lose its position but its
+// content is removed
+static void srp_diff_free_content(struct lyd_node *node)
+{
+	struct lyd_node *iter = NULL;
+	struct lyd_node *next = NULL;
+
+	LY_LIST_FOR_SAFE(lyd_child_no_keys(node), next, iter)
+		lyd_free_tree(iter);
+}
+
+
+static bool_t srp_diff_is_anonymous(const struct lyd_node *node)
+{
+	if ((node->schema->nodetype & LYS_LIST) &&
+		(node->schema->flags & LYS_KEYLESS))
+		return BOOL_TRUE;
+	if ((node->schema->nodetype & LYS_LEAFLIST) &&
+		(node->schema->flags & LYS_CONFIG_R))
+		return BOOL_TRUE;
+
+	return BOOL_FALSE;
+}
+
+
+// Remove identical subtrees from both sibling lists. The 'first' and
+// 'second' are updated when the first sibling is removed.
+static void srp_diff_prune_siblings(struct lyd_node **first,
+	struct lyd_node **second)
+{
+	struct lyd_node *iter = NULL;
+	struct lyd_node *next = NULL;
+
+	LY_LIST_FOR_SAFE(*second, next, iter) {
+		struct lyd_node *match = NULL;
+
+		// List keys can't be removed. They are equal within matched
+		// entries anyway
+		if (iter->schema->flags & LYS_KEY)
+			continue;
+		// Instances of key-less list and state leaf-list can't be
+		// identified. The lyd_find_sibling_first() finds the first
+		// instance whatever its content is, so such nodes are left
+		// for lyd_diff_siblings()
+		if (srp_diff_is_anonymous(iter))
+			continue;
+		if (lyd_find_sibling_first(*first, iter, &match) != LY_SUCCESS)
+			continue;
+
+		// Changed subtree. Prune its children
+		if (!srp_diff_is_equal(match, iter)) {
+			struct lyd_node *first_child = lyd_child(match);
+			struct lyd_node *second_child = lyd_child(iter);
+			if (first_child && second_child)
+				srp_diff_prune_siblings(&first_child,
+					&second_child);
+			continue;
+		}
+
+		if (iter->schema->flags & LYS_ORDBYUSER) {
+			srp_diff_free_content(match);
+			srp_diff_free_content(iter);
+			continue;
+		}
+		if (match == *first)
+			*first = match->next;
+		if (iter == *second)
+			*second = iter->next;
+		lyd_free_tree(match);
+		lyd_free_tree(iter);
+	}
+}
+
+
+// Diff of 'first' and 'second' trees. The trees are pruned so they are not
+// usable after diff. The pointers to first nodes are updated.
+bool_t srp_diff_trees(struct lyd_node **first, struct lyd_node **second,
+	struct lyd_node **diff)
+{
+	assert(first);
+	assert(second);
+	assert(diff);
+	if (!first || !second || !diff)
+		return BOOL_FALSE;
+
+	if (*first && *second) {
+		srp_diff_hash_siblings(*first);
+		srp_diff_hash_siblings(*second);
+		srp_diff_prune_siblings(first, second);
+	}
+
+	if (lyd_diff_siblings(*first, *second, 0, diff) != LY_SUCCESS)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// Data to compare. It's fetched from datastore or loaded from snapshot
+typedef struct {
+	sr_data_t *data; // Datastore data
+	struct lyd_node *tree; // Snapshot data
+	const struct ly_ctx *ctx; // Context is acquired for snapshot
+} srp_diff_src_t;
+
+
+// Snapshot is LYB file. The selected nodes are copied with their parents
+// like sysrepo does.
+static bool_t srp_diff_src_load_file(sr_session_ctx_t *sess, const char *fn,
+	const char *xpath, srp_diff_src_t *src)
+{
+	struct lyd_node *tree = NULL;
+	struct ly_set *set = NULL;
+	uint32_t i = 0;
+
+	src->ctx = sr_session_acquire_context(sess);
+	if (lyd_parse_data_path(src->ctx, fn, LYD_LYB, LYD_PARSE_ONLY, 0,
+		&tree) != LY_SUCCESS)
+		return BOOL_FALSE;
+	if (!tree || (faux_str_cmp(xpath, "/*") == 0)) {
+		src->tree = tree;
+		return BOOL_TRUE;
+	}
+
+	if (lyd_find_xpath(tree, xpath, &set) != LY_SUCCESS) {
+		lyd_free_siblings(tree);
+		return BOOL_FALSE;
+	}
+	for (i = 0; i < set->count; i++) {
+		struct lyd_node *dup = NULL;
+		if (lyd_dup_single(set->dnodes[i], NULL,
+			LYD_DUP_RECURSIVE | LYD_DUP_WITH_PARENTS, &dup) !=
+			LY_SUCCESS)
+			continue;
+		while (lyd_parent(dup))
+			dup = lyd_parent(dup);
+		lyd_merge_siblings(&src->tree, dup, LYD_MERGE_DESTRUCT);
+	}
+	ly_set_free(set, NULL);
+	lyd_free_siblings(tree);
+
+	return BOOL_TRUE;
+}
+
+
+// Snapshot path is explicit so file can't be confused with datastore
+static const char *srp_diff_src_file(const char *source)
+{
+	size_t len = strlen(SRP_DIFF_FILE_PREFIX);
+
+	if (faux_str_cmpn(source, SRP_DIFF_FILE_PREFIX, len) != 0)
+		return NULL;
+	if ('\0' == source[len])
+		return NULL;
+
+	return source + len;
+}
+
+
+// The source is a full datastore name or "file:<path>" of LYB snapshot
+bool_t srp_diff_src_is_valid(const char *source)
+{
+	sr_datastore_t ds = SRP_REPO_EDIT;
+
+	if (!source)
+		return BOOL_FALSE;
+	if (srp_diff_src_file(source))
+		return BOOL_TRUE;
+
+	return kly_str2ds(source, strlen(source), &ds);
+}
+
+
+// The source is a datastore name or "file:<path>" of LYB snapshot. NULL
+// source means default datastore.
+static bool_t srp_diff_src_load(sr_session_ctx_t *sess, const char *source,
+	sr_datastore_t ds, const char *xpath, srp_diff_src_t *src)
+{
+	const char *fn = NULL;
+
+	if (source && (fn = srp_diff_src_file(source)))
+		return srp_diff_src_load_file(sess, fn, xpath, src);
+	if (source && !kly_str2ds(source, strlen(source), &ds))
+		return BOOL_FALSE;
+
+	sr_session_switch_ds(sess, ds);
+	if (sr_get_data(sess, xpath, 0, 0, 0, &src->data) != SR_ERR_OK)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static struct lyd_node **srp_diff_src_tree(srp_diff_src_t *src)
+{
+	if (src->data)
+		return &src->data->tree;
+
+	return &src->tree;
+}
+
+
+static void srp_diff_src_free(sr_session_ctx_t *sess, srp_diff_src_t *src)
+{
+	if (src->data)
+		sr_release_data(src->data);
+	if (src->tree)
+		lyd_free_siblings(src->tree);
+	if (src->ctx)
+		sr_session_release_context(sess);
+}
+
+
+// Diff between two sources. The source is a datastore name or
+// "file:<path>" of LYB snapshot. NULL 'from' is running and NULL 'to' is candidate.
+// The NULL diff means there are no changes.
+bool_t srp_diff_get_sources(sr_session_ctx_t *sess, const char *from,
+	const char *to, const char *xpath, volatile sig_atomic_t *cancel,
+	struct lyd_node **diff)
+{
+	sr_datastore_t ds = SRP_REPO_EDIT;
+	srp_diff_src_t src_from = {};
+	srp_diff_src_t src_to = {};
+	bool_t ret = BOOL_FALSE;
+
+	assert(sess);
+	assert(diff);
+	if (!sess || !diff)
+		return BOOL_FALSE;
+	*diff = NULL;
+	ds = sr_session_get_ds(sess);
+
+	if (!xpath)
+		xpath = "/*";
+
+	if (!srp_diff_src_load(sess, to, SRP_REPO_EDIT, xpath, &src_to))
+		goto err;
+
+	// Interrupted while fetching
+	if (cancel && *cancel)
+		goto err;
+
+	if (!srp_diff_src_load(sess, from, SR_DS_RUNNING, xpath, &src_from))
+		goto err;
+
+	if (!srp_diff_trees(srp_diff_src_tree(&src_from),
+		srp_diff_src_tree(&src_to), diff))
+		goto err;
+
+	ret = BOOL_TRUE;
+err:
+	srp_diff_src_free(sess, &src_from);
+	srp_diff_src_free(sess, &src_to);
+	sr_session_switch_ds(sess, ds);
+
+	return ret;
+}
+
+
+// Diff between candidate and running. The journal (can be NULL) limits
+// compared subtrees. The NULL diff means there are no changes.
+bool_t srp_diff_get(sr_session_ctx_t *sess, const srp_journal_t *journal,
+	const char *xpath, volatile sig_atomic_t *cancel, struct lyd_node **diff)
+{
+	char *journal_xpath = NULL;
+	bool_t ret = BOOL_FALSE;
+
+	assert(diff);
+	if (!diff)
+		return BOOL_FALSE;
+	*diff = NULL;
+
+	if (!xpath)
+		xpath = "/*";
+
+	// Compare touched subtrees only
+	journal_xpath = srp_journal_xpath(journal, xpath);
+	if (journal_xpath) {
+		// Nothing is changed
+		if (faux_str_is_empty(journal_xpath)) {
+			faux_str_free(journal_xpath);
+			return BOOL_TRUE;
+		}
+		xpath = journal_xpath;
+	}
+
+	ret = srp_diff_get_sources(sess, NULL, NULL, xpath, cancel, diff);
+	faux_str_free(journal_xpath);
+
+	return ret;
+}
+
+
+// Count operations within diff subtree. The subtree of created or deleted
+// node is a single operation.
+static void srp_diff_count(const struct lyd_node *node, srp_diff_stat_t *stat)
+{
+	const struct lyd_node *iter = NULL;
+	struct lyd_meta *meta = NULL;
+	const char *op = NULL;
+
+	meta = lyd_find_meta(node->meta, NULL, "yang:operation");
+	if (meta)
+		op = lyd_get_meta_value(meta);
+	if (faux_str_cmp(op, "create") == 0) {
+		stat->created++;
+		return;
+	}
+	if (faux_str_cmp(op, "delete") == 0) {
+		stat->deleted++;
+		return;
+	}
+	if (faux_str_cmp(op, "replace") == 0)
+		stat->replaced++;
+
+	LY_LIST_FOR(lyd_child(node), iter)
+		srp_diff_count(iter, stat);
+}
+
+
+static void srp_diff_stat_add(srp_diff_stat_t *to, const srp_diff_stat_t *from)
+{
+	to->created += from->created;
+	to->deleted += from->deleted;
+	to->replaced += from->replaced;
+}
+
+
+// Statistics of diff. The 'stat' array contains total number of operations
+// for each module followed by numbers for its top level nodes. Returns
+// number of array entries. The array must be freed by faux_free(). The
+// strings belong to YANG context.
+size_t srp_diff_stat(const struct lyd_node *diff, srp_diff_stat_t **stat)
+{
+	srp_diff_stat_t *nodes = NULL;
+	size_t nodes_num = 0;
+	srp_diff_stat_t *res = NULL;
+	size_t res_num = 0;
+	const struct lyd_node *iter = NULL;
+	size_t i = 0;
+
+	assert(stat);
+	if (!stat)
+		return 0;
+	*stat = NULL;
+
+	// Top level nodes. The entries of top level list are summed up
+	LY_LIST_FOR(diff, iter) {
+		srp_diff_stat_t cur = {};
+
+		cur.module = iter->schema->module->name;
+		cur.name = iter->schema->name;
+		srp_diff_count(iter, &cur);
+		for (i = 0; i < nodes_num; i++) {
+			if ((nodes[i].name == cur.name) &&
+				(nodes[i].module == cur.module))
+				break;
+		}
+		if (i == nodes_num) {
+			nodes_num++;
+			nodes = realloc(nodes, nodes_num * sizeof(*nodes));
+			assert(nodes);
+			nodes[i] = cur;
+			continue;
+		}
+		srp_diff_stat_add(&nodes[i], &cur);
+	}
+	if (0 == nodes_num)
+		return 0;
+
+	// Group nodes by modules. Module is added on its first node
+	res = faux_zmalloc(nodes_num * 2 * sizeof(*res));
+	assert(res);
+	for (i = 0; i < nodes_num; i++) {
+		size_t j = 0;
+		size_t module_idx = 0;
+
+		for (j = 0; j < i; j++) {
+			if (nodes[j].module == nodes[i].module)
+				break;
+		}
+		if (j < i) // Module is already added
+			continue;
+		module_idx = res_num++;
+		res[module_idx].module = nodes[i].module;
+		for (j = i; j < nodes_num; j++) {
+			if (nodes[j].module != nodes[i].module)
+				continue;
+			res[res_num++] = nodes[j];
+			srp_diff_stat_add(&res[module_idx], &nodes[j]);
+		}
+	}
+	free(nodes);
+	*stat = res;
+
+	return res_num;
+}
+
+
+// Position of user-ordered instance within edit. The diff's 'yang:key' or
+// 'yang:value' is a preceding instance. The empty one means the first
+// position.
+static void srp_diff_edit_order(const struct lyd_node *node,
+	struct lyd_node *edit)
+{
+	const char *name = NULL;
+	const char *value = NULL;
+	struct lyd_meta *meta = NULL;
+
+	if (!(node->schema->flags & LYS_ORDBYUSER))
+		return;
+	name = (node->schema->nodetype & LYS_LIST) ? "yang:key" : "yang:value";
+	meta = lyd_find_meta(node->meta, NULL, name);
+	if (!meta)
+		return;
+
+	value = lyd_get_meta_value(meta);
+	if (faux_str_is_empty(value)) {
+		lyd_new_meta(LYD_CTX(edit), edit, NULL, "yang:insert", "first",
+			0, NULL);
+		return;
+	}
+	lyd_new_meta(LYD_CTX(edit), edit, NULL, "yang:insert", "after", 0, NULL);
+	lyd_new_meta(LYD_CTX(edit), edit, NULL, name, value, 0, NULL);
+}
+
+
+static bool_t srp_diff_edit_node(const struct lyd_node *node,
+	const char *parent_op, struct lyd_node *parent, struct lyd_node **edit)
+{
+	struct lyd_meta *meta = NULL;
+	const char *op = parent_op;
+	uint32_t dup_opts = LYD_DUP_NO_META;
+	struct lyd_node *dup = NULL;
+	const struct lyd_node *iter = NULL;
+
+	meta = lyd_find_meta(node->meta, NULL, "yang:operation");
+	if (meta)
+		op = lyd_get_meta_value(meta);
+
+	// Created subtree is copied entirely. The list keys are always copied
+	if (faux_str_cmp(op, "create") == 0)
+		dup_opts |= LYD_DUP_RECURSIVE;
+	if (lyd_dup_single(node, (struct lyd_node_inner *)parent, dup_opts,
+		&dup) != LY_SUCCESS)
+		return BOOL_FALSE;
+	if (!parent)
+		lyd_insert_sibling(*edit, dup, edit);
+
+	if (faux_str_cmp(op, "delete") == 0) {
+		if (lyd_new_meta(LYD_CTX(dup), dup, NULL,
+			"ietf-netconf:operation", "remove", 0, NULL) != LY_SUCCESS)
+			return BOOL_FALSE;
+		return BOOL_TRUE;
+	}
+	if ((faux_str_cmp(op, "create") == 0) ||
+		(faux_str_cmp(op, "replace") == 0))
+		srp_diff_edit_order(node, dup);
+	if (faux_str_cmp(op, "create") == 0)
+		return BOOL_TRUE;
+
+	// Unchanged or replaced node. Its children have own operations
+	LY_LIST_FOR(lyd_child_no_keys(node), iter) {
+		if (!srp_diff_edit_node(iter, "none", dup, edit))
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Convert diff to sysrepo edit. The edit is applied by 'merge' default
+// operation. It changes the nodes within diff only.
+bool_t srp_diff_edit(const struct lyd_node *diff, struct lyd_node **edit)
+{
+	const struct lyd_node *iter = NULL;
+
+	assert(edit);
+	if (!edit)
+		return BOOL_FALSE;
+	*edit = NULL;
+
+	LY_LIST_FOR(diff, iter) {
+		if (!srp_diff_edit_node(iter, "none", NULL, edit)) {
+			lyd_free_siblings(*edit);
+			*edit = NULL;
+			return BOOL_FALSE;
+		}
+	}
+
+	return BOOL_TRUE;
+}
@@ -0,0 +1,555 @@
+/** @file journal.c
+ * @brief Journal of candidate changes.
+ *
+ * The 'diff' compares candidate and running datastores. Usually operator
+ * changes a few nodes only but full comparison fetches and walks the whole
+ * configuration. The journal stores XPaths of subtrees touched by edit
+ * operations of current session. So 'diff' can fetch and compare touched
+ * subtrees only. The journal is compacted: the XPath within already
+ * journaled subtree is not stored and the descendants of new XPath are
+ * removed. The 'check' and 'commit' use modules of touched subtrees to
+ * validate changed modules only.
+ *
+ * The journal is valid while nobody else changes candidate or running
+ * datastores. The journal subscribes to changes of both datastores and
+ * counts changes originated by other sysrepo sessions. The subscriptions
+ * are made lazily by the first edit operation so sessions which don't edit
+ * configuration don't load sysrepo with subscriptions. Candidate can be
+ * already changed by somebody before subscription so the journal is seeded
+ * by subtrees of candidate vs running diff. The journal is reset by
+ * 'commit' and 'reset' operations.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <syslog.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/list.h>
+#include <faux/argv.h>
+
+#include <sysrepo.h>
+
+#include "klish_plugin_sysrepo.h"
+
+// Journal is not used when there are too many touched subtrees. The full
+// comparison is faster than a huge union of XPaths.
+#define SRP_JOURNAL_MAX 512
+
+
+struct srp_journal_s {
+	sr_session_ctx_t *sess; // Own session to subscribe to changes
+	sr_subscription_ctx_t *sub;
+	bool_t started; // Subscription is tried
+	uint32_t sr_id; // Session whose changes are journaled
+	faux_list_t *xpaths; // Touched subtrees
+	bool_t overflow; // Changes can't be journaled
+	volatile unsigned int stamp; // Foreign changes. Sysrepo thread writes it
+	unsigned int base; // Value of stamp on journal reset
+};
+
+
+static int srp_journal_change_cb(sr_session_ctx_t *session, uint32_t sub_id,
+	const char *module_name, const char *xpath, sr_event_t event,
+	uint32_t request_id, void *private_data)
+{
+	srp_journal_t *journal = (srp_journal_t *)private_data;
+
+	// Own changes are journaled already
+	if (sr_session_get_event_sr_id(session) != journal->sr_id)
+		journal->stamp++;
+
+	sub_id = sub_id;
+	module_name = module_name;
+	xpath = xpath;
+	event = event;
+	request_id = request_id;
+
+	return SR_ERR_OK;
+}
+
+
+// Subscribe to all modules with data within current datastore of session
+static void srp_journal_subscribe(srp_journal_t *journal)
+{
+	const struct ly_ctx *ctx = NULL;
+	const struct lys_module *module = NULL;
+	uint32_t i = 0;
+
+	ctx = sr_session_acquire_context(journal->sess);
+	while ((module = ly_ctx_get_module_iter(ctx, &i))) {
+		if (!module->implemented || !module->compiled ||
+			!module->compiled->data)
+			continue;
+		// Modules without configuration data can fail. It's ok
+		sr_module_change_subscribe(journal->sess, module->name, NULL,
+			srp_journal_change_cb, journal, 0,
+			SR_SUBSCR_DONE_ONLY | SR_SUBSCR_PASSIVE, &journal->sub);
+	}
+	sr_session_release_context(journal->sess);
+}
+
+
+srp_journal_t *srp_journal_new(sr_conn_ctx_t *conn, uint32_t sr_id)
+{
+	srp_journal_t *journal = NULL;
+
+	assert(conn);
+	if (!conn)
+		return NULL;
+
+	journal = faux_zmalloc(sizeof(*journal));
+	assert(journal);
+	if (!journal)
+		return NULL;
+	journal->sr_id = sr_id;
+	journal->xpaths = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))faux_str_free);
+	journal->overflow = BOOL_TRUE;
+	journal->started = BOOL_FALSE;
+	journal->stamp = 0;
+	journal->base = 0;
+
+	if (sr_session_start(conn, SR_DS_CANDIDATE, &journal->sess) !=
+		SR_ERR_OK) {
+		srp_journal_free(journal);
+		return NULL;
+	}
+
+	return journal;
+}
+
+
+void srp_journal_free(srp_journal_t *journal)
+{
+	if (!journal)
+		return;
+
+	if (journal->sub)
+		sr_unsubscribe(journal->sub);
+	if (journal->sess)
+		sr_session_stop(journal->sess);
+	faux_list_free(journal->xpaths);
+	faux_free(journal);
+}
+
+
+// Start of the last segment of XPath. The '/' within predicates is not a
+// separator
+static const char *srp_journal_last_segment(const char *xpath)
+{
+	const char *p = NULL;
+	const char *last = NULL;
+	size_t depth = 0;
+	char quote = '\0';
+
+	for (p = xpath; *p; p++) {
+		if (quote) {
+			if (*p == quote)
+				quote = '\0';
+			continue;
+		}
+		if (('\'' == *p) || ('"' == *p))
+			quote = *p;
+		else if ('[' == *p)
+			depth++;
+		else if ((']' == *p) && (depth > 0))
+			depth--;
+		else if (('/' == *p) && (0 == depth))
+			last = p;
+	}
+
+	return last;
+}
+
+
+// The 'ancestor' selects 'xpath' or its ancestor. The list XPath without
+// predicates selects all its entries.
+static bool_t srp_journal_is_ancestor(const char *ancestor, const char *xpath)
+{
+	size_t len = strlen(ancestor);
+
+	if (strncmp(ancestor, xpath, len) != 0)
+		return BOOL_FALSE;
+	if (('\0' == xpath[len]) || ('/' == xpath[len]) || ('[' == xpath[len]))
+		return BOOL_TRUE;
+
+	return BOOL_FALSE;
+}
+
+
+// Node within choice can implicitly delete nodes of other cases
+static bool_t srp_journal_is_in_choice(srp_journal_t *journal,
+	const char *xpath)
+{
+	const struct ly_ctx *ctx = NULL;
+	struct ly_set *set = NULL;
+	const struct lysc_node *node = NULL;
+	bool_t in_choice = BOOL_FALSE;
+
+	ctx = sr_session_acquire_context(journal->sess);
+	if ((lys_find_xpath(ctx, NULL, xpath, 0, &set) == LY_SUCCESS) &&
+		(set->count > 0)) {
+		for (node = set->snodes[0]->parent;
+			node && (node->nodetype & (LYS_CHOICE | LYS_CASE));
+			node = node->parent)
+			in_choice = BOOL_TRUE;
+	}
+	ly_set_free(set, NULL);
+	sr_session_release_context(journal->sess);
+
+	return in_choice;
+}
+
+
+static void srp_journal_add_subtree(srp_journal_t *journal, char *xpath)
+{
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *node = NULL;
+
+	// Top level node within choice or something unexpected
+	if (faux_str_is_empty(xpath)) {
+		faux_str_free(xpath);
+		journal->overflow = BOOL_TRUE;
+		return;
+	}
+
+	iter = faux_list_head(journal->xpaths);
+	while ((node = faux_list_each_node(&iter))) {
+		const char *cur = (const char *)faux_list_data(node);
+
+		// Already journaled
+		if (srp_journal_is_ancestor(cur, xpath)) {
+			faux_str_free(xpath);
+			return;
+		}
+		// New subtree contains journaled one
+		if (srp_journal_is_ancestor(xpath, cur))
+			faux_list_del(journal->xpaths, node);
+	}
+
+	if (faux_list_len(journal->xpaths) >= SRP_JOURNAL_MAX) {
+		faux_str_free(xpath);
+		journal->overflow = BOOL_TRUE;
+		return;
+	}
+	faux_list_add(journal->xpaths, xpath);
+}
+
+
+static void srp_journal_add_path(srp_journal_t *journal, const char *xpath)
+{
+	const char *last = NULL;
+
+	if (journal->overflow)
+		return;
+
+	// Parent is touched when case is changed
+	if (srp_journal_is_in_choice(journal, xpath) &&
+		(last = srp_journal_last_segment(xpath))) {
+		srp_journal_add_subtree(journal,
+			faux_str_dupn(xpath, last - xpath));
+		return;
+	}
+
+	srp_journal_add_subtree(journal, faux_str_dup(xpath));
+}
+
+
+// All entries of user-ordered list or leaf-list are touched by order change
+// so predicates of entry are removed
+static void srp_journal_add_order_path(srp_journal_t *journal,
+	const char *xpath)
+{
+	const char *last = NULL;
+	const char *pred = NULL;
+
+	if (journal->overflow)
+		return;
+
+	last = srp_journal_last_segment(xpath);
+	if (last)
+		pred = strchr(last, '[');
+	if (!pred) {
+		srp_journal_add_path(journal, xpath);
+		return;
+	}
+
+	srp_journal_add_subtree(journal, faux_str_dupn(xpath, pred - xpath));
+}
+
+
+// Changed subtrees of diff. The node with operation is changed entirely
+static void srp_journal_seed_nodes(srp_journal_t *journal,
+	const struct lyd_node *nodes_list)
+{
+	const struct lyd_node *iter = NULL;
+
+	LY_LIST_FOR(nodes_list, iter) {
+		char *path = NULL;
+		struct lyd_meta *meta = NULL;
+
+		if (journal->overflow)
+			return;
+		meta = lyd_find_meta(iter->meta, NULL, "yang:operation");
+		if (!meta || (faux_str_cmp(lyd_get_meta_value(meta),
+			"none") == 0)) {
+			srp_journal_seed_nodes(journal, lyd_child_no_keys(iter));
+			continue;
+		}
+		path = lyd_path(iter, LYD_PATH_STD, NULL, 0);
+		if (!path) {
+			journal->overflow = BOOL_TRUE;
+			return;
+		}
+		if (iter->schema->flags & LYS_ORDBYUSER)
+			srp_journal_add_order_path(journal, path);
+		else
+			srp_journal_add_path(journal, path);
+		free(path);
+	}
+}
+
+
+// Subscribe to changes and seed journal by changes made before
+// subscription. It's done once on the first edit.
+static void srp_journal_start(srp_journal_t *journal)
+{
+	struct lyd_node *diff = NULL;
+
+	if (journal->started)
+		return;
+	journal->started = BOOL_TRUE;
+
+	srp_journal_subscribe(journal);
+	sr_session_switch_ds(journal->sess, SR_DS_RUNNING);
+	srp_journal_subscribe(journal);
+	sr_session_switch_ds(journal->sess, SR_DS_CANDIDATE);
+	if (!journal->sub) {
+		syslog(LOG_WARNING, "Can't subscribe to candidate changes");
+		return;
+	}
+
+	// Foreign changes made during seeding make journal invalid
+	journal->base = journal->stamp;
+	if (!srp_diff_get(journal->sess, NULL, NULL, NULL, &diff))
+		return;
+	journal->overflow = BOOL_FALSE;
+	srp_journal_seed_nodes(journal, diff);
+	lyd_free_siblings(diff);
+}
+
+
+// Journal touched subtree. The journal can be disabled (NULL)
+void srp_journal_add(srp_journal_t *journal, const char *xpath)
+{
+	if (!journal || !xpath)
+		return;
+	srp_journal_start(journal);
+	srp_journal_add_path(journal, xpath);
+}
+
+
+// Journal order of user-ordered list or leaf-list
+void srp_journal_add_order(srp_journal_t *journal, const char *xpath)
+{
+	if (!journal || !xpath)
+		return;
+	srp_journal_start(journal);
+	srp_journal_add_order_path(journal, xpath);
+}
+
+
+// Stamp of foreign changes. It's taken before commit or reset and then it's
+// used to reset journal. So foreign changes made during operation are not
+// lost.
+unsigned int srp_journal_stamp(const srp_journal_t *journal)
+{
+	if (!journal)
+		return 0;
+
+	return journal->stamp;
+}
+
+
+// Candidate is equal to running now. Foreign changes are not tracked
+// without subscription so journal stays invalid until the first edit.
+void srp_journal_reset(srp_journal_t *journal, unsigned int stamp)
+{
+	faux_list_node_t *iter = NULL;
+	faux_list_node_t *node = NULL;
+
+	if (!journal)
+		return;
+
+	iter = faux_list_head(journal->xpaths);
+	while ((node = faux_list_each_node(&iter)))
+		faux_list_del(journal->xpaths, node);
+	if (!journal->sub)
+		return;
+	journal->overflow = BOOL_FALSE;
+	journal->base = stamp;
+}
+
+
+bool_t srp_journal_is_valid(const srp_journal_t *journal)
+{
+	if (!journal)
+		return BOOL_FALSE;
+	if (journal->overflow)
+		return BOOL_FALSE;
+	if (journal->stamp != journal->base)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// Union of touched subtrees within 'xpath'. It's used to fetch data to
+// compare. NULL means the journal can't be used. The empty string means
+// nothing is changed.
+char *srp_journal_xpath(const srp_journal_t *journal, const char *xpath)
+{
+	faux_list_node_t *iter = NULL;
+	const char *cur = NULL;
+	char *union_xpath = NULL;
+	bool_t all = BOOL_FALSE;
+
+	if (!srp_journal_is_valid(journal))
+		return NULL;
+
+	all = (!xpath || (faux_str_cmp(xpath, "/*") == 0));
+	iter = faux_list_head(journal->xpaths);
+	while ((cur = (const char *)faux_list_each(&iter))) {
+		if (!all) {
+			// Whole requested subtree is touched
+			if (srp_journal_is_ancestor(cur, xpath)) {
+				faux_str_free(union_xpath);
+				return faux_str_dup(xpath);
+			}
+			if (!srp_journal_is_ancestor(xpath, cur))
+				continue;
+		}
+		if (union_xpath)
+			faux_str_cat(&union_xpath, " | ");
+		faux_str_cat(&union_xpath, cur);
+	}
+
+	if (!union_xpath)
+		return faux_str_dup("");
+
+	return union_xpath;
+}
+
+
+// Module of top level node of XPath
+static char *srp_journal_module(const char *xpath)
+{
+	const char *colon = NULL;
+
+	if ('/' == *xpath)
+		xpath++;
+	colon = strchr(xpath, ':');
+	if (!colon || (colon == xpath))
+		return NULL;
+
+	return faux_str_dupn(xpath, colon - xpath);
+}
+
+
+static bool_t srp_journal_argv_has(const faux_argv_t *argv, const char *str)
+{
+	faux_argv_node_t *iter = faux_argv_iter(argv);
+	const char *cur = NULL;
+
+	while ((cur = faux_argv_each(&iter))) {
+		if (faux_str_cmp(cur, str) == 0)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Modules to validate after changes of 'changed' modules. These are changed
+// modules and modules which import them. Data of importing module can refer
+// to changed data by leafref, 'must' or 'when'.
+void srp_journal_affected(sr_session_ctx_t *sess, const faux_argv_t *changed,
+	faux_argv_t *modules)
+{
+	const struct ly_ctx *ctx = NULL;
+	const struct lys_module *module = NULL;
+	uint32_t i = 0;
+
+	assert(sess);
+	assert(modules);
+	if (!sess || !modules)
+		return;
+	if (faux_argv_len(changed) == 0)
+		return;
+
+	ctx = sr_session_acquire_context(sess);
+	while ((module = ly_ctx_get_module_iter(ctx, &i))) {
+		bool_t affected = BOOL_FALSE;
+		LY_ARRAY_COUNT_TYPE u = 0;
+
+		if (!module->implemented || !module->compiled ||
+			!module->compiled->data)
+			continue;
+		if (srp_journal_argv_has(changed, module->name)) {
+			affected = BOOL_TRUE;
+		} else if (!module->parsed) {
+			// Imports are unknown so module can refer to changed one
+			affected = BOOL_TRUE;
+		} else {
+			LY_ARRAY_FOR(module->parsed->imports, u) {
+				if (srp_journal_argv_has(changed,
+					module->parsed->imports[u].name)) {
+					affected = BOOL_TRUE;
+					break;
+				}
+			}
+		}
+		if (affected)
+			faux_argv_add(modules, module->name);
+	}
+	sr_session_release_context(sess);
+}
+
+
+// Modules to validate after journaled changes. Returns BOOL_FALSE when the
+// journal can't be used. The empty list means nothing is changed.
+bool_t srp_journal_modules(const srp_journal_t *journal, faux_argv_t *modules)
+{
+	faux_list_node_t *iter = NULL;
+	const char *cur = NULL;
+	faux_argv_t *changed = NULL;
+
+	assert(modules);
+	if (!modules)
+		return BOOL_FALSE;
+	if (!srp_journal_is_valid(journal))
+		return BOOL_FALSE;
+
+	changed = faux_argv_new();
+	iter = faux_list_head(journal->xpaths);
+	while ((cur = (const char *)faux_list_each(&iter))) {
+		char *name = srp_journal_module(cur);
+
+		if (!name) {
+			faux_argv_free(changed);
+			return BOOL_FALSE;
+		}
+		if (!srp_journal_argv_has(changed, name))
+			faux_argv_add(changed, name);
+		faux_str_free(name);
+	}
+	srp_journal_affected(journal->sess, changed, modules);
+	faux_argv_free(changed);
+
+	return BOOL_TRUE;
+}
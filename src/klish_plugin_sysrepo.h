@@ -1,8 +1,11 @@
 #ifndef _klish_pligin_sysrepo_h
 #define _klish_plugin_sysrepo_h
 
+#include <stdarg.h>
+#include <signal.h>
 #include <sysrepo.h>
 #include <sysrepo/xpath.h>
+#include <sysrepo/values.h>
 #include <faux/faux.h>
 #include <faux/argv.h>
 #include <faux/list.h>
@@ -140,6 +143,88 @@ typedef enum {
 } pt_e;
 
 
+// Per-user NACM view of YANG schema
+typedef struct srp_nacm_s srp_nacm_t;
+
+
+// Buffered output sink
+typedef struct srp_sink_s srp_sink_t;
+
+
+// Shared cache of rendered output
+typedef struct srp_cache_s srp_cache_t;
+
+
+// Journal of candidate changes
+typedef struct srp_journal_s srp_journal_t;
+
+
+// Write-behind persistence of startup-config
+typedef struct srp_persist_s srp_persist_t;
+
+
+// Number of diff operations for module or top level node
+typedef struct {
+	const char *module; // Module name
+	const char *name; // Top level node name. NULL for module total
+	size_t created;
+	size_t deleted;
+	size_t replaced;
+} srp_diff_stat_t;
+
+
+// Output format of show and diff
+typedef enum {
+	SHOW_DISPLAY_TEXT, // Hierarchical text
+	SHOW_DISPLAY_SET, // Flat KPath lines with 'set'/'del' commands
+	SHOW_DISPLAY_XML, // Machine-readable formats printed by libyang
+	SHOW_DISPLAY_JSON,
+	SHOW_DISPLAY_LYB,
+} show_display_e;
+
+
+// Parse/show settings
+typedef struct {
+	char begin_bracket;
+	char end_bracket;
+	bool_t show_brackets;
+	bool_t show_semicolons;
+	bool_t first_key_w_stmt;
+	bool_t keys_w_stmt;
+	bool_t colorize;
+	uint8_t indent;
+	bool_t default_keys;
+	bool_t show_default_keys;
+	bool_t hide_passwords;
+	bool_t enable_nacm;
+	bool_t oneliners;
+	uint32_t compl_timeout; // Timeout for completion data sources, ms
+	uint32_t compl_latency; // Latency budget for completion sources, ms
+	uint32_t show_depth; // Depth of shown hierarchy. 0 means unlimited
+	uint32_t show_chunk; // List entries fetched at once by show. 0 - all
+	uint32_t show_threads; // Number of threads to render output
+	char *show_cache_dir; // Dir to cache rendered output. NULL - no cache
+	bool_t diff_journal; // Journal changes to compare touched subtrees only
+	bool_t incremental_commit; // Commit the diff only
+	bool_t write_behind; // Store startup-config in background
+	bool_t deferred_apply; // Accumulate edits within session
+	uint32_t deferred_limit; // Max number of deferred edits. 0 - unlimited
+	srp_nacm_t *nacm; // NACM view. Runtime field, not a setting
+	size_t show_depth_base; // Depth of shown subtree. Runtime field
+	sr_session_ctx_t *show_sess; // Session for chunked show. Runtime field
+	show_display_e show_display; // Output format. Runtime field
+	const char *show_match; // Regex to filter shown nodes. Runtime field
+	const char *show_except; // Regex to hide nodes. Runtime field
+	bool_t show_count; // Show number of matched entries. Runtime field
+	uint32_t show_last; // Show last N list entries. Runtime field
+	uint32_t show_first; // Page size of list. Runtime field
+	uint32_t show_skip; // Number of skipped list entries. Runtime field
+	const char *show_from; // First key of list page. Runtime field
+	const char *show_to; // Last key of list page. Runtime field
+	bool_t show_state; // Annotate config with state data. Runtime field
+} pline_opts_t;
+
+
 // Plain EXPRession
 typedef struct {
 	char *xpath;
@@ -166,6 +251,8 @@ typedef struct {
 	const struct lysc_node *node;
 	char *xpath;
 	sr_datastore_t xpath_ds;
+	sr_get_options_t xpath_opts; // Operational datastore options
+	uint32_t xpath_timeout; // Timeout of operational subscribers, ms
 	pat_e pat;
 } pcompl_t;
 
@@ -173,30 +260,13 @@ typedef struct {
 // Plain LINE
 typedef struct pline_s {
 	sr_session_ctx_t *sess;
+	const pline_opts_t *opts;
 	bool_t invalid;
 	faux_list_t *exprs;
 	faux_list_t *compls;
 } pline_t;
 
 
-// Parse/show settings
-typedef struct {
-	char begin_bracket;
-	char end_bracket;
-	bool_t show_brackets;
-	bool_t show_semicolons;
-	bool_t first_key_w_stmt;
-	bool_t keys_w_stmt;
-	bool_t colorize;
-	uint8_t indent;
-	bool_t default_keys;
-	bool_t show_default_keys;
-	bool_t hide_passwords;
-	bool_t enable_nacm;
-	bool_t oneliners;
-} pline_opts_t;
-
-
 #define SRP_NODETYPE_CONF (LYS_CONTAINER | LYS_LIST | LYS_LEAF | LYS_LEAFLIST | LYS_CHOICE | LYS_CASE)
 
 
@@ -215,7 +285,7 @@ void pline_free(pline_t *pline);
 
 void pline_debug(const pline_t *pline);
 void pline_print_completions(const pline_t *pline, bool_t help,
-	pt_e enabled_types, bool_t existing_nodes_only);
+	pt_e enabled_types, bool_t existing_nodes_only, srp_sink_t *sink);
 
 size_t num_of_keys(const struct lysc_node *node);
 
@@ -232,9 +302,25 @@ typedef struct {
 	sr_conn_ctx_t *sr_conn; // Sysrepo connection
 	sr_session_ctx_t *sr_sess; // Sysrepo session
 	sr_subscription_ctx_t *nacm_sub;
+	srp_nacm_t *nacm; // NACM view of schema for current user
+	srp_cache_t *cache; // Shared cache of rendered output
+	srp_journal_t *journal; // Journal of candidate changes
+	srp_persist_t *persist; // Background writer of startup-config
+	bool_t deferred; // Edits are not applied immediately
+	size_t deferred_num; // Number of edits not applied yet
+	bool_t startup_synced; // Startup-config is written by own last commit
 } srp_udata_t;
 
 
+// Own Sysrepo connection of async symbol executed within forked process
+typedef struct {
+	sr_conn_ctx_t *sr_conn;
+	sr_session_ctx_t *sr_sess;
+	sr_subscription_ctx_t *nacm_sub;
+	bool_t nacm;
+} srp_async_t;
+
+
 // Repository to edit with srp commands
 #define SRP_REPO_EDIT SR_DS_CANDIDATE
 
@@ -283,9 +369,16 @@ int srp_insert(kcontext_t *context);
 int srp_verify(kcontext_t *context);
 int srp_commit(kcontext_t *context);
 int srp_reset(kcontext_t *context);
+int srp_save(kcontext_t *context);
+int srp_begin(kcontext_t *context);
+int srp_flush(kcontext_t *context);
+int srp_apply(kcontext_t *context);
 int srp_show_abs(kcontext_t *context);
 int srp_show(kcontext_t *context);
 int srp_diff(kcontext_t *context);
+int srp_show_abs_async(kcontext_t *context);
+int srp_show_async(kcontext_t *context);
+int srp_diff_async(kcontext_t *context);
 int srp_deactivate(kcontext_t *context);
 
 // Service functions
@@ -297,10 +390,16 @@ int srp_mass_op(char op, int fd, sr_datastore_t ds, const faux_argv_t *cur_path,
 	const pline_opts_t *opts, const char *user, bool_t stop_on_error);
 
 // Plugin's user-data service functions
+srp_udata_t *srp_udata(kcontext_t *context);
 pline_opts_t *srp_udata_opts(kcontext_t *context);
 faux_argv_t *srp_udata_path(kcontext_t *context);
 void srp_udata_set_path(kcontext_t *context, faux_argv_t *path);
 sr_session_ctx_t *srp_udata_sr_sess(kcontext_t *context);
+srp_cache_t *srp_udata_cache(kcontext_t *context);
+srp_journal_t *srp_udata_journal(kcontext_t *context);
+srp_persist_t *srp_udata_persist(kcontext_t *context);
+bool_t srp_async_connect(kcontext_t *context, srp_async_t *async);
+void srp_async_disconnect(srp_async_t *async);
 
 // Private
 enum diff_op {
@@ -311,9 +410,12 @@ enum diff_op {
 };
 
 bool_t show_xpath(sr_session_ctx_t *sess, const char *xpath,
-	size_t xpath_depth, pline_opts_t *opts);
+	size_t xpath_depth, pline_opts_t *opts, srp_sink_t *sink);
 void show_subtree(const struct lyd_node *nodes_list, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner);
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink);
+void show_diff_stat(const struct lyd_node *diff, pline_opts_t *opts,
+	srp_sink_t *sink);
 
 // kly helper library
 typedef struct {
@@ -327,19 +429,88 @@ int klysc_key_kcompare(const void *key, const void *list_item);
 bool_t klysc_node_ext(const struct lysc_node *node,
 	const char *module, const char *name, const char **argument);
 bool_t klysc_node_ext_is_password(const struct lysc_node *node);
+bool_t klysc_node_ext_is_hidden(const struct lysc_node *node);
 const char *klysc_node_ext_completion(const struct lysc_node *node);
 const char *klysc_node_ext_default(const struct lysc_node *node);
+bool_t kly_str_need_esc(const char *str);
 char *klyd_node_value(const struct lyd_node *node);
+const char *klyd_node_value_ref(const struct lyd_node *node, char **escaped);
 const struct lysc_node *klysc_find_child(const struct lysc_node *node,
 	const char *name);
 char *klysc_leafref_xpath(const struct lysc_node *node,
 	const struct lysc_type *type, const char *node_path);
 const char *klysc_identityref_prefix(struct lysc_type_identityref *type,
 	const char *name);
+bool_t klyd_node_is_visible(const struct lyd_node *node);
 size_t klyd_visible_child_num(const struct lyd_node *node);
+const struct lyd_node *klyd_visible_child_first(const struct lyd_node *node,
+	size_t *num);
 bool_t kly_str2ds(const char *str, size_t len, sr_datastore_t *ds);
 bool_t kly_parse_ext_xpath(const char *xpath, const char **raw_xpath,
-	sr_datastore_t *ds);
+	sr_datastore_t *ds, sr_get_options_t *get_opts, uint32_t *timeout);
+int kly_get_items(sr_session_ctx_t *sess, const char *xpath,
+	sr_get_options_t get_opts, uint32_t timeout, uint32_t latency,
+	sr_val_t **vals, size_t *val_num);
+
+// NACM view
+srp_nacm_t *srp_nacm_new(sr_conn_ctx_t *conn, const char *user);
+void srp_nacm_free(srp_nacm_t *nacm);
+bool_t srp_nacm_node_allowed(srp_nacm_t *nacm, const struct lysc_node *node);
+
+// Output sink
+srp_sink_t *srp_sink_new(int fd);
+srp_sink_t *srp_sink_new_context(kcontext_t *context);
+srp_sink_t *srp_sink_new_mem(void);
+const char *srp_sink_data(const srp_sink_t *sink, size_t *len);
+void srp_sink_truncate(srp_sink_t *sink, size_t len);
+void srp_sink_free(srp_sink_t *sink);
+bool_t srp_sink_error(srp_sink_t *sink);
+void srp_sink_set_cancel(srp_sink_t *sink, volatile sig_atomic_t *cancel);
+bool_t srp_sink_flush(srp_sink_t *sink);
+bool_t srp_sink_write(srp_sink_t *sink, const char *data, size_t len);
+bool_t srp_sink_puts(srp_sink_t *sink, const char *str);
+bool_t srp_sink_vprintf(srp_sink_t *sink, const char *fmt, va_list ap);
+bool_t srp_sink_printf(srp_sink_t *sink, const char *fmt, ...);
+
+// Rendered output cache
+srp_cache_t *srp_cache_new(sr_conn_ctx_t *conn, const char *dir);
+void srp_cache_free(srp_cache_t *cache);
+bool_t srp_cache_show(srp_cache_t *cache, sr_session_ctx_t *sess,
+	const char *xpath, size_t xpath_depth, pline_opts_t *opts, int fd,
+	bool_t *failed);
+
+// Diff of large data trees
+bool_t srp_diff_trees(struct lyd_node **first, struct lyd_node **second,
+	struct lyd_node **diff);
+bool_t srp_diff_src_is_valid(const char *source);
+bool_t srp_diff_get_sources(sr_session_ctx_t *sess, const char *from,
+	const char *to, const char *xpath, volatile sig_atomic_t *cancel,
+	struct lyd_node **diff);
+bool_t srp_diff_get(sr_session_ctx_t *sess, const srp_journal_t *journal,
+	const char *xpath, volatile sig_atomic_t *cancel, struct lyd_node **diff);
+size_t srp_diff_stat(const struct lyd_node *diff, srp_diff_stat_t **stat);
+bool_t srp_diff_edit(const struct lyd_node *diff, struct lyd_node **edit);
+
+// Journal of candidate changes
+srp_journal_t *srp_journal_new(sr_conn_ctx_t *conn, uint32_t sr_id);
+void srp_journal_free(srp_journal_t *journal);
+void srp_journal_add(srp_journal_t *journal, const char *xpath);
+void srp_journal_add_order(srp_journal_t *journal, const char *xpath);
+unsigned int srp_journal_stamp(const srp_journal_t *journal);
+void srp_journal_reset(srp_journal_t *journal, unsigned int stamp);
+bool_t srp_journal_is_valid(const srp_journal_t *journal);
+char *srp_journal_xpath(const srp_journal_t *journal, const char *xpath);
+bool_t srp_journal_modules(const srp_journal_t *journal, faux_argv_t *modules);
+void srp_journal_affected(sr_session_ctx_t *sess, const faux_argv_t *changed,
+	faux_argv_t *modules);
+
+// Write-behind startup-config
+srp_persist_t *srp_persist_new(sr_conn_ctx_t *conn);
+void srp_persist_free(srp_persist_t *persist);
+void srp_persist_request(srp_persist_t *persist);
+bool_t srp_persist_flush(srp_persist_t *persist);
+void srp_persist_status(srp_persist_t *persist, bool_t *pending,
+	bool_t *failed);
 
 C_DECL_END
 
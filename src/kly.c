@@ -4,11 +4,14 @@
 #include <string.h>
 #include <assert.h>
 #include <syslog.h>
+#include <time.h>
+#include <inttypes.h>
 
 #include <faux/faux.h>
 #include <faux/str.h>
 #include <faux/list.h>
 #include <faux/argv.h>
+#include <faux/conv.h>
 
 #include <sysrepo.h>
 #include <sysrepo/xpath.h>
@@ -120,6 +123,16 @@ bool_t klysc_node_ext_is_password(const struct lysc_node *node)
 }
 
 
+bool_t klysc_node_ext_is_hidden(const struct lysc_node *node)
+{
+	// Fast path. Most nodes have no extensions at all
+	if (!node || !node->exts)
+		return BOOL_FALSE;
+
+	return klysc_node_ext(node, "klish", "hidden", NULL);
+}
+
+
 const char *klysc_node_ext_completion(const struct lysc_node *node)
 {
 	const char *xpath = NULL;
@@ -141,11 +154,63 @@ const char *klysc_node_ext_default(const struct lysc_node *node)
 
 
 // Get value from data lyd node
-char *klyd_node_value(const struct lyd_node *node)
+// SWAR helpers. Each byte of 64-bit word is checked simultaneously
+#define KLY_ONES ((uint64_t)0x0101010101010101ULL)
+#define KLY_HIGHS ((uint64_t)0x8080808080808080ULL)
+#define KLY_HAS_LESS(x, n) (((x) - KLY_ONES * (n)) & ~(x) & KLY_HIGHS)
+#define KLY_HAS_ZERO(x) KLY_HAS_LESS(x, 1)
+#define KLY_HAS_BYTE(x, n) KLY_HAS_ZERO((x) ^ (KLY_ONES * (n)))
+
+
+static bool_t kly_char_need_esc(unsigned char c)
+{
+	if ((c <= ' ') || (c >= 0x7f))
+		return BOOL_TRUE;
+	if (('"' == c) || ('\'' == c) || ('\\' == c))
+		return BOOL_TRUE;
+
+	return BOOL_FALSE;
+}
+
+
+// Check if string contains characters that need escaping or quoting:
+// spaces, control characters, quotes, backslashes and non-ASCII bytes.
+// Empty string needs quoting too. The string is checked by 8 bytes at once.
+bool_t kly_str_need_esc(const char *str)
+{
+	size_t len = 0;
+	size_t i = 0;
+
+	if (!str)
+		return BOOL_FALSE;
+	len = strlen(str);
+	if (0 == len)
+		return BOOL_TRUE;
+
+	for (i = 0; (i + sizeof(uint64_t)) <= len; i += sizeof(uint64_t)) {
+		uint64_t x = 0;
+		memcpy(&x, str + i, sizeof(x));
+		if ((x & KLY_HIGHS) ||
+			KLY_HAS_LESS(x, ' ' + 1) ||
+			KLY_HAS_BYTE(x, 0x7f) ||
+			KLY_HAS_BYTE(x, '"') ||
+			KLY_HAS_BYTE(x, '\'') ||
+			KLY_HAS_BYTE(x, '\\'))
+			return BOOL_TRUE;
+	}
+	for (; i < len; i++) {
+		if (kly_char_need_esc((unsigned char)str[i]))
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+static const char *klyd_node_origin_value(const struct lyd_node *node)
 {
 	const struct lysc_node *schema = NULL;
 	const struct lysc_type *type = NULL;
-	const char *origin_value = NULL;
 
 	if (!node)
 		return NULL;
@@ -160,18 +225,50 @@ char *klyd_node_value(const struct lyd_node *node)
 		type = ((const struct lysc_node_leaflist *)schema)->type;
 
 	if (type->basetype != LY_TYPE_IDENT) {
-		origin_value = lyd_get_value(node);
+		return lyd_get_value(node);
 	} else {
 		// Identity
 		const struct lyd_value *value = NULL;
 		value = &((const struct lyd_node_term *)node)->value;
-		origin_value = value->ident->name;
+		return value->ident->name;
 	}
 
+	return NULL;
+}
+
+
+char *klyd_node_value(const struct lyd_node *node)
+{
+	const char *origin_value = klyd_node_origin_value(node);
+
+	if (!origin_value)
+		return NULL;
+	if (!kly_str_need_esc(origin_value))
+		return faux_str_dup(origin_value);
+
 	return faux_str_c_esc_quote(origin_value);
 }
 
 
+// Get node value ready to output without copying. If value needs escaping
+// the escaped copy is stored to 'escaped' and must be freed by caller.
+// Else 'escaped' is set to NULL and the value within data tree is returned.
+const char *klyd_node_value_ref(const struct lyd_node *node, char **escaped)
+{
+	const char *origin_value = klyd_node_origin_value(node);
+
+	assert(escaped);
+	*escaped = NULL;
+	if (!origin_value)
+		return NULL;
+	if (!kly_str_need_esc(origin_value))
+		return origin_value;
+	*escaped = faux_str_c_esc_quote(origin_value);
+
+	return *escaped;
+}
+
+
 // Don't use standard lys_find_child() because it checks given module to be
 // equal to found node's module. So augmented nodes will not be found.
 const struct lysc_node *klysc_find_child(const struct lysc_node *node,
@@ -187,6 +284,8 @@ const struct lysc_node *klysc_find_child(const struct lysc_node *node,
 			continue;
 		if (!(iter->flags & LYS_CONFIG_W))
 			continue;
+		if (klysc_node_ext_is_hidden(iter))
+			continue;
 		// Special case. LYS_CHOICE and LYS_CASE must search for
 		// specified name inside themselfs.
 		if (iter->nodetype & (LYS_CHOICE | LYS_CASE)) {
@@ -416,6 +515,26 @@ char *klysc_leafref_xpath(const struct lysc_node *node,
 }
 
 
+// Node is shown within configuration
+bool_t klyd_node_is_visible(const struct lyd_node *node)
+{
+	if (!node)
+		return BOOL_FALSE;
+	if (node->flags & LYD_DEFAULT)
+		return BOOL_FALSE;
+	if (!(node->schema->nodetype & SRP_NODETYPE_CONF))
+		return BOOL_FALSE;
+	if (!(node->schema->flags & LYS_CONFIG_W)) // config is true
+		return BOOL_FALSE;
+	if (node->schema->flags & LYS_KEY)
+		return BOOL_FALSE;
+	if (klysc_node_ext_is_hidden(node->schema))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
 size_t klyd_visible_child_num(const struct lyd_node *node)
 {
 	const struct lyd_node *nodes_list = NULL;
@@ -429,21 +548,52 @@ size_t klyd_visible_child_num(const struct lyd_node *node)
 		return 0;
 
 	LY_LIST_FOR(nodes_list, iter) {
-		if (iter->flags & LYD_DEFAULT)
-			continue;
-		if (!(iter->schema->nodetype & SRP_NODETYPE_CONF))
-			continue;
-		if (!(iter->schema->flags & LYS_CONFIG_W)) // config is true
-			continue;
-		if (iter->schema->flags & LYS_KEY)
-			continue;
-		num++;
+		if (klyd_node_is_visible(iter))
+			num++;
 	}
 
 	return num;
 }
 
 
+// Get first visible child. The 'num' is a number of visible children but
+// it's limited by 2. The renderer needs to know if node has zero, one or
+// more children only so the search stops on the second visible child.
+const struct lyd_node *klyd_visible_child_first(const struct lyd_node *node,
+	size_t *num)
+{
+	const struct lyd_node *iter = NULL;
+	const struct lyd_node *first = NULL;
+	size_t found = 0;
+
+	if (node) {
+		LY_LIST_FOR(lyd_child(node), iter) {
+			if (!klyd_node_is_visible(iter))
+				continue;
+			if (!first)
+				first = iter;
+			found++;
+			if (found > 1)
+				break;
+		}
+	}
+	if (num)
+		*num = found;
+
+	return first;
+}
+
+
+// Full name match. The prefix of datastore name is not a datastore.
+static bool_t kly_str_is_ds(const char *str, size_t len, const char *name)
+{
+	if (strlen(name) != len)
+		return BOOL_FALSE;
+
+	return (faux_str_cmpn(str, name, len) == 0);
+}
+
+
 bool_t kly_str2ds(const char *str, size_t len, sr_datastore_t *ds)
 {
 	if (!str)
@@ -453,18 +603,16 @@ bool_t kly_str2ds(const char *str, size_t len, sr_datastore_t *ds)
 	if (!ds)
 		return BOOL_FALSE;
 
-	if (faux_str_cmpn(str, "candidate", len) == 0)
+	if (kly_str_is_ds(str, len, "candidate"))
 		*ds = SR_DS_CANDIDATE;
-	else if (faux_str_cmpn(str, "running", len) == 0)
+	else if (kly_str_is_ds(str, len, "running"))
 		*ds = SR_DS_RUNNING;
-	else if (faux_str_cmpn(str, "operational", len) == 0)
+	else if (kly_str_is_ds(str, len, "operational"))
 		*ds = SR_DS_OPERATIONAL;
-	else if (faux_str_cmpn(str, "startup", len) == 0)
+	else if (kly_str_is_ds(str, len, "startup"))
 		*ds = SR_DS_STARTUP;
-#ifdef SR_DS_FACTORY_DEFAULT
-	else if (faux_str_cmpn(str, "factory-default", len) == 0)
+	else if (kly_str_is_ds(str, len, "factory-default"))
 		*ds = SR_DS_FACTORY_DEFAULT;
-#endif
 	else // No DS prefix found
 		return BOOL_FALSE;
 
@@ -472,10 +620,63 @@ bool_t kly_str2ds(const char *str, size_t len, sr_datastore_t *ds)
 }
 
 
+// Operational datastore options of completion source. The options can be
+// specified within klish:completion extension after datastore name, e.g.
+// "operational,stored,timeout=200 /if:interfaces-state/interface/name"
+typedef struct {
+	const char *name;
+	sr_get_options_t flag;
+} kly_oper_opt_t;
+
+static const kly_oper_opt_t kly_oper_opts[] = {
+	{"stored", SR_OPER_NO_SUBS},
+	{"no-state", SR_OPER_NO_STATE},
+	{"no-config", SR_OPER_NO_CONFIG},
+	{"no-stored", SR_OPER_NO_STORED},
+	{NULL, 0}
+};
+
+
+static bool_t kly_parse_src_opt(const char *str, size_t len, sr_datastore_t ds,
+	sr_get_options_t *get_opts, uint32_t *timeout)
+{
+	const char *tmo = "timeout=";
+	size_t tmo_len = strlen(tmo);
+	const kly_oper_opt_t *opt = NULL;
+
+	if ((len > tmo_len) && (faux_str_cmpn(str, tmo, tmo_len) == 0)) {
+		char *num = faux_str_dupn(str + tmo_len, len - tmo_len);
+		unsigned int val = 0;
+		bool_t res = faux_conv_atoui(num, &val, 10);
+		faux_str_free(num);
+		if (!res)
+			return BOOL_FALSE;
+		*timeout = val;
+		return BOOL_TRUE;
+	}
+
+	// SR_OPER_* flags are meaningful for operational datastore only
+	if (ds != SR_DS_OPERATIONAL)
+		return BOOL_FALSE;
+
+	for (opt = kly_oper_opts; opt->name; opt++) {
+		if ((strlen(opt->name) == len) &&
+			(faux_str_cmpn(str, opt->name, len) == 0)) {
+			*get_opts |= opt->flag;
+			return BOOL_TRUE;
+		}
+	}
+
+	return BOOL_FALSE;
+}
+
+
 bool_t kly_parse_ext_xpath(const char *xpath, const char **raw_xpath,
-	sr_datastore_t *ds)
+	sr_datastore_t *ds, sr_get_options_t *get_opts, uint32_t *timeout)
 {
 	char *space = NULL;
+	sr_get_options_t parsed_opts = 0;
+	uint32_t parsed_timeout = 0;
 
 	if (!xpath)
 		return BOOL_FALSE;
@@ -488,10 +689,83 @@ bool_t kly_parse_ext_xpath(const char *xpath, const char **raw_xpath,
 	*raw_xpath = xpath;
 	space = strchr(xpath, ' ');
 	if (space) {
-		size_t len = space - xpath;
-		if (kly_str2ds(xpath, len, ds))
+		const char *comma = memchr(xpath, ',', space - xpath);
+		size_t len = (comma ? comma : space) - xpath;
+
+		if (kly_str2ds(xpath, len, ds)) {
+			// Source options: "<ds>,<opt>,<opt> <xpath>"
+			while (comma) {
+				const char *opt = comma + 1;
+				comma = memchr(opt, ',', space - opt);
+				len = (comma ? comma : space) - opt;
+				if (!kly_parse_src_opt(opt, len, *ds,
+					&parsed_opts, &parsed_timeout))
+					syslog(LOG_WARNING, "Unknown completion "
+						"source option in \"%s\"", xpath);
+			}
 			*raw_xpath = space + 1;
+		}
 	}
 
+	if (get_opts)
+		*get_opts = parsed_opts;
+	if (timeout)
+		*timeout = parsed_timeout;
+
 	return BOOL_TRUE;
 }
+
+
+static uint64_t kly_time_ms(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+// Get items for completion. The operational datastore can call slow
+// operational subscribers. So the timeout is used and on error the stored
+// operational data (without subscribers) is used as a partial result. The
+// sources that exceed latency budget are logged.
+int kly_get_items(sr_session_ctx_t *sess, const char *xpath,
+	sr_get_options_t get_opts, uint32_t timeout, uint32_t latency,
+	sr_val_t **vals, size_t *val_num)
+{
+	int rc = SR_ERR_OK;
+	uint64_t start = 0;
+	uint64_t elapsed = 0;
+	bool_t fallback = BOOL_FALSE;
+	sr_datastore_t ds = SRP_REPO_EDIT;
+
+	assert(sess);
+	assert(vals);
+	assert(val_num);
+
+	*vals = NULL;
+	*val_num = 0;
+	ds = sr_session_get_ds(sess);
+	if (ds != SR_DS_OPERATIONAL)
+		get_opts = 0;
+
+	start = kly_time_ms();
+	rc = sr_get_items(sess, xpath, timeout, get_opts, vals, val_num);
+	if ((rc != SR_ERR_OK) && (ds == SR_DS_OPERATIONAL) &&
+		!(get_opts & SR_OPER_NO_SUBS)) {
+		// Slow or failed subscriber. Use stored data only
+		fallback = BOOL_TRUE;
+		rc = sr_get_items(sess, xpath, timeout,
+			get_opts | SR_OPER_NO_SUBS, vals, val_num);
+	}
+	elapsed = kly_time_ms() - start;
+
+	if ((latency > 0) && (elapsed > latency))
+		syslog(LOG_WARNING, "Completion source \"%s\" exceeds latency "
+			"budget: %" PRIu64 " ms (budget %u ms)%s",
+			xpath, elapsed, latency,
+			fallback ? ", partial result" : "");
+
+	return rc;
+}
@@ -0,0 +1,504 @@
+/** @file nacm.c
+ * @brief Per-user NACM view of YANG schema.
+ *
+ * Sysrepo filters data reads using NACM but parser and completion work with
+ * YANG schema and don't know about NACM rules. So the denied nodes fail later
+ * within sysrepo. The NACM view resolves NACM rules for the user to schema
+ * nodes once per session. The parser and completion use it to skip subtrees
+ * the user can neither read nor write. The view is rebuilt when NACM
+ * configuration is changed.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <syslog.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/list.h>
+
+#include <sysrepo.h>
+#include <sysrepo/xpath.h>
+#include <sysrepo/netconf_acm.h>
+
+#include "klish_plugin_sysrepo.h"
+
+#define NACM_MODULE "ietf-netconf-acm"
+#define NACM_XPATH "/" NACM_MODULE ":nacm"
+
+
+// Resolved NACM rule
+typedef struct {
+	char *module; // NULL means any module
+	bool_t has_path; // Rule is restricted by data path
+	const struct lysc_node *node; // Schema node of rule's data path
+	bool_t exact; // Data path has no instance predicates
+	bool_t read;
+	bool_t write;
+	bool_t permit;
+} srp_nacm_rule_t;
+
+
+// Cached access decision for schema node
+typedef struct {
+	const struct lysc_node *node;
+	bool_t allowed;
+} srp_nacm_decision_t;
+
+
+struct srp_nacm_s {
+	sr_session_ctx_t *sess; // Own session without NACM user
+	sr_subscription_ctx_t *sub;
+	char *user;
+	volatile bool_t dirty;
+	bool_t full_access;
+	bool_t read_default;
+	bool_t write_default;
+	faux_list_t *rules;
+	faux_list_t *decisions;
+};
+
+
+static void srp_nacm_rule_free(srp_nacm_rule_t *rule)
+{
+	if (!rule)
+		return;
+	faux_str_free(rule->module);
+	faux_free(rule);
+}
+
+
+static int srp_nacm_decision_compare(const void *first, const void *second)
+{
+	const srp_nacm_decision_t *f = (const srp_nacm_decision_t *)first;
+	const srp_nacm_decision_t *s = (const srp_nacm_decision_t *)second;
+
+	if (f->node == s->node)
+		return 0;
+
+	return (f->node < s->node) ? -1 : 1;
+}
+
+
+static int srp_nacm_decision_kcompare(const void *key, const void *list_item)
+{
+	const struct lysc_node *f = (const struct lysc_node *)key;
+	const srp_nacm_decision_t *s = (const srp_nacm_decision_t *)list_item;
+
+	if (f == s->node)
+		return 0;
+
+	return (f < s->node) ? -1 : 1;
+}
+
+
+static void srp_nacm_clear(srp_nacm_t *nacm)
+{
+	faux_list_free(nacm->rules);
+	nacm->rules = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (faux_list_free_fn)srp_nacm_rule_free);
+	faux_list_free(nacm->decisions);
+	nacm->decisions = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+		srp_nacm_decision_compare, srp_nacm_decision_kcompare,
+		(faux_list_free_fn)faux_free);
+	nacm->full_access = BOOL_FALSE;
+	nacm->read_default = BOOL_TRUE;
+	nacm->write_default = BOOL_FALSE;
+}
+
+
+static const char *srp_nacm_leaf_value(const struct lyd_node *parent,
+	const char *name)
+{
+	const struct lyd_node *iter = NULL;
+
+	LY_LIST_FOR(lyd_child(parent), iter) {
+		if (faux_str_cmp(iter->schema->name, name) == 0)
+			return lyd_get_value(iter);
+	}
+
+	return NULL;
+}
+
+
+// Check if leaf-list with specified name contains value
+static bool_t srp_nacm_leaflist_has(const struct lyd_node *parent,
+	const char *name, const char *value, bool_t any_matches)
+{
+	const struct lyd_node *iter = NULL;
+
+	LY_LIST_FOR(lyd_child(parent), iter) {
+		const char *v = NULL;
+		if (faux_str_cmp(iter->schema->name, name) != 0)
+			continue;
+		v = lyd_get_value(iter);
+		if (any_matches && (faux_str_cmp(v, "*") == 0))
+			return BOOL_TRUE;
+		if (faux_str_cmp(v, value) == 0)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Remove instance predicates from data path to get schema path
+static char *srp_nacm_schema_path(const char *path, bool_t *exact)
+{
+	char *res = NULL;
+	const char *pos = path;
+	const char *start = path;
+	size_t depth = 0;
+	char quote = '\0';
+
+	*exact = BOOL_TRUE;
+	for (pos = path; *pos != '\0'; pos++) {
+		if (quote) {
+			if (*pos == quote)
+				quote = '\0';
+			continue;
+		}
+		if ((depth > 0) && ((*pos == '\'') || (*pos == '"'))) {
+			quote = *pos;
+		} else if (*pos == '[') {
+			if (0 == depth)
+				faux_str_catn(&res, start, pos - start);
+			depth++;
+			*exact = BOOL_FALSE;
+		} else if ((*pos == ']') && (depth > 0)) {
+			depth--;
+			if (0 == depth)
+				start = pos + 1;
+		}
+	}
+	if ((0 == depth) && (start != pos))
+		faux_str_catn(&res, start, pos - start);
+
+	return res;
+}
+
+
+static void srp_nacm_access_ops(const char *ops, bool_t *read, bool_t *write)
+{
+	*read = BOOL_FALSE;
+	*write = BOOL_FALSE;
+	if (!ops || (faux_str_cmp(ops, "*") == 0)) {
+		*read = BOOL_TRUE;
+		*write = BOOL_TRUE;
+		return;
+	}
+	if (strstr(ops, "read"))
+		*read = BOOL_TRUE;
+	if (strstr(ops, "create") || strstr(ops, "update") ||
+		strstr(ops, "delete"))
+		*write = BOOL_TRUE;
+}
+
+
+static void srp_nacm_add_rule(srp_nacm_t *nacm, const struct ly_ctx *ctx,
+	const struct lyd_node *rule_node)
+{
+	srp_nacm_rule_t *rule = NULL;
+	const char *module = NULL;
+	const char *path = NULL;
+
+	// RPC and notification rules are not interesting for data nodes
+	if (srp_nacm_leaf_value(rule_node, "rpc-name") ||
+		srp_nacm_leaf_value(rule_node, "notification-name"))
+		return;
+
+	rule = faux_zmalloc(sizeof(*rule));
+	assert(rule);
+	module = srp_nacm_leaf_value(rule_node, "module-name");
+	if (module && (faux_str_cmp(module, "*") != 0))
+		rule->module = faux_str_dup(module);
+	srp_nacm_access_ops(srp_nacm_leaf_value(rule_node, "access-operations"),
+		&rule->read, &rule->write);
+	rule->permit = (faux_str_cmp(
+		srp_nacm_leaf_value(rule_node, "action"), "permit") == 0);
+
+	path = srp_nacm_leaf_value(rule_node, "path");
+	if (path) {
+		char *schema_path = srp_nacm_schema_path(path, &rule->exact);
+		rule->has_path = BOOL_TRUE;
+		if (schema_path)
+			rule->node = lys_find_path(ctx, NULL, schema_path, 0);
+		faux_str_free(schema_path);
+		// Unknown path. The rule can't be applied to schema
+		if (!rule->node) {
+			srp_nacm_rule_free(rule);
+			return;
+		}
+	}
+
+	faux_list_add(nacm->rules, rule);
+}
+
+
+static bool_t srp_nacm_build(srp_nacm_t *nacm)
+{
+	sr_data_t *data = NULL;
+	const struct lyd_node *iter = NULL;
+	const struct ly_ctx *ctx = NULL;
+	faux_list_t *groups = NULL;
+	const char *val = NULL;
+
+	srp_nacm_clear(nacm);
+	nacm->dirty = BOOL_FALSE;
+
+	if (faux_str_cmp(nacm->user, sr_nacm_get_recovery_user()) == 0) {
+		nacm->full_access = BOOL_TRUE;
+		return BOOL_TRUE;
+	}
+
+	if (sr_get_data(nacm->sess, NACM_XPATH, 0, 0, 0, &data) != SR_ERR_OK) {
+		// Don't prune anything. Sysrepo will check access itself
+		nacm->full_access = BOOL_TRUE;
+		return BOOL_FALSE;
+	}
+	if (!data) {
+		nacm->full_access = BOOL_TRUE;
+		return BOOL_TRUE;
+	}
+
+	if ((val = srp_nacm_leaf_value(data->tree, "enable-nacm")) &&
+		(faux_str_cmp(val, "false") == 0))
+		nacm->full_access = BOOL_TRUE;
+	if ((val = srp_nacm_leaf_value(data->tree, "read-default")))
+		nacm->read_default = (faux_str_cmp(val, "permit") == 0);
+	if ((val = srp_nacm_leaf_value(data->tree, "write-default")))
+		nacm->write_default = (faux_str_cmp(val, "permit") == 0);
+
+	// User's groups
+	groups = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, NULL);
+	LY_LIST_FOR(lyd_child(data->tree), iter) {
+		const struct lyd_node *group = NULL;
+		if (faux_str_cmp(iter->schema->name, "groups") != 0)
+			continue;
+		LY_LIST_FOR(lyd_child(iter), group) {
+			if (srp_nacm_leaflist_has(group, "user-name",
+				nacm->user, BOOL_FALSE))
+				faux_list_add(groups, (void *)
+					srp_nacm_leaf_value(group, "name"));
+		}
+	}
+
+	// Rules from rule-lists applicable to user's groups
+	ctx = LYD_CTX(data->tree);
+	LY_LIST_FOR(lyd_child(data->tree), iter) {
+		const struct lyd_node *rule = NULL;
+		faux_list_node_t *g_iter = NULL;
+		const char *group = NULL;
+		bool_t applicable = BOOL_FALSE;
+
+		if (faux_str_cmp(iter->schema->name, "rule-list") != 0)
+			continue;
+		if (srp_nacm_leaflist_has(iter, "group", "*", BOOL_TRUE))
+			applicable = BOOL_TRUE;
+		g_iter = faux_list_head(groups);
+		while (!applicable &&
+			(group = (const char *)faux_list_each(&g_iter))) {
+			if (srp_nacm_leaflist_has(iter, "group", group, BOOL_FALSE))
+				applicable = BOOL_TRUE;
+		}
+		if (!applicable)
+			continue;
+		LY_LIST_FOR(lyd_child(iter), rule) {
+			if (faux_str_cmp(rule->schema->name, "rule") != 0)
+				continue;
+			srp_nacm_add_rule(nacm, ctx, rule);
+		}
+	}
+	faux_list_free(groups);
+	sr_release_data(data);
+
+	return BOOL_TRUE;
+}
+
+
+static int srp_nacm_change_cb(sr_session_ctx_t *session, uint32_t sub_id,
+	const char *module_name, const char *xpath, sr_event_t event,
+	uint32_t request_id, void *private_data)
+{
+	srp_nacm_t *nacm = (srp_nacm_t *)private_data;
+
+	nacm->dirty = BOOL_TRUE;
+
+	session = session;
+	sub_id = sub_id;
+	module_name = module_name;
+	xpath = xpath;
+	event = event;
+	request_id = request_id;
+
+	return SR_ERR_OK;
+}
+
+
+srp_nacm_t *srp_nacm_new(sr_conn_ctx_t *conn, const char *user)
+{
+	srp_nacm_t *nacm = NULL;
+
+	assert(conn);
+	if (!conn)
+		return NULL;
+
+	nacm = faux_zmalloc(sizeof(*nacm));
+	assert(nacm);
+	if (!nacm)
+		return NULL;
+
+	// Initialize
+	nacm->user = faux_str_dup(user);
+	nacm->dirty = BOOL_TRUE;
+	nacm->sess = NULL;
+	nacm->sub = NULL;
+	nacm->rules = NULL;
+	nacm->decisions = NULL;
+	srp_nacm_clear(nacm);
+
+	// NACM configuration itself is protected by NACM so use own session
+	// without NACM user
+	if (sr_session_start(conn, SR_DS_RUNNING, &nacm->sess) != SR_ERR_OK) {
+		srp_nacm_free(nacm);
+		return NULL;
+	}
+	if (sr_module_change_subscribe(nacm->sess, NACM_MODULE, NULL,
+		srp_nacm_change_cb, nacm, 0,
+		SR_SUBSCR_DONE_ONLY | SR_SUBSCR_PASSIVE, &nacm->sub) != SR_ERR_OK) {
+		syslog(LOG_WARNING, "Can't subscribe to NACM changes");
+		nacm->sub = NULL;
+	}
+
+	return nacm;
+}
+
+
+void srp_nacm_free(srp_nacm_t *nacm)
+{
+	if (!nacm)
+		return;
+
+	if (nacm->sub)
+		sr_unsubscribe(nacm->sub);
+	if (nacm->sess)
+		sr_session_stop(nacm->sess);
+	faux_list_free(nacm->rules);
+	faux_list_free(nacm->decisions);
+	faux_str_free(nacm->user);
+
+	faux_free(nacm);
+}
+
+
+static bool_t srp_nacm_is_ancestor(const struct lysc_node *ancestor,
+	const struct lysc_node *node)
+{
+	const struct lysc_node *iter = NULL;
+
+	for (iter = node; iter; iter = iter->parent) {
+		if (iter == ancestor)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+static bool_t srp_nacm_ext_default_deny(const struct lysc_node *node,
+	const char *name)
+{
+	const struct lysc_node *iter = NULL;
+
+	for (iter = node; iter; iter = iter->parent) {
+		if (klysc_node_ext(iter, NACM_MODULE, name, NULL))
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+static bool_t srp_nacm_access(const srp_nacm_t *nacm,
+	const struct lysc_node *node, bool_t write)
+{
+	faux_list_node_t *iter = NULL;
+	srp_nacm_rule_t *rule = NULL;
+
+	iter = faux_list_head(nacm->rules);
+	while ((rule = (srp_nacm_rule_t *)faux_list_each(&iter))) {
+		if (!(write ? rule->write : rule->read))
+			continue;
+		if (rule->module &&
+			(faux_str_cmp(rule->module, node->module->name) != 0))
+			continue;
+		if (rule->has_path) {
+			if (!srp_nacm_is_ancestor(rule->node, node))
+				continue;
+			// Rule for some instances only. Don't deny the whole
+			// schema node
+			if (!rule->exact && !rule->permit)
+				continue;
+		}
+		return rule->permit;
+	}
+
+	if (srp_nacm_ext_default_deny(node, "default-deny-all"))
+		return BOOL_FALSE;
+	if (write && srp_nacm_ext_default_deny(node, "default-deny-write"))
+		return BOOL_FALSE;
+
+	return write ? nacm->write_default : nacm->read_default;
+}
+
+
+// Some descendant of node can be explicitly permitted
+static bool_t srp_nacm_descendant_permitted(const srp_nacm_t *nacm,
+	const struct lysc_node *node)
+{
+	faux_list_node_t *iter = NULL;
+	srp_nacm_rule_t *rule = NULL;
+
+	iter = faux_list_head(nacm->rules);
+	while ((rule = (srp_nacm_rule_t *)faux_list_each(&iter))) {
+		if (!rule->permit || !rule->has_path)
+			continue;
+		if ((rule->node != node) && srp_nacm_is_ancestor(node, rule->node))
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Node is visible to user if user can read or write it
+bool_t srp_nacm_node_allowed(srp_nacm_t *nacm, const struct lysc_node *node)
+{
+	srp_nacm_decision_t *decision = NULL;
+
+	if (!nacm || !node)
+		return BOOL_TRUE;
+
+	if (nacm->dirty)
+		srp_nacm_build(nacm);
+	if (nacm->full_access)
+		return BOOL_TRUE;
+
+	decision = (srp_nacm_decision_t *)faux_list_kfind(nacm->decisions, node);
+	if (decision)
+		return decision->allowed;
+
+	decision = faux_zmalloc(sizeof(*decision));
+	assert(decision);
+	decision->node = node;
+	decision->allowed = srp_nacm_access(nacm, node, BOOL_FALSE) ||
+		srp_nacm_access(nacm, node, BOOL_TRUE) ||
+		srp_nacm_descendant_permitted(nacm, node);
+	faux_list_add(nacm->decisions, decision);
+
+	return decision->allowed;
+}
@@ -0,0 +1,184 @@
+/** @file persist.c
+ * @brief Write-behind persistence of running-config to startup-config.
+ *
+ * The 'commit' updates running-config and then copies it to startup-config.
+ * The startup-config is usually stored on flash and writing takes more time
+ * than commit itself. In write-behind mode the 'commit' returns as soon as
+ * running-config is updated. The background thread copies running-config to
+ * startup-config. Requests are counted by generations. The single write
+ * covers all requests made before it starts so bursts of commits are
+ * coalesced into one write.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <syslog.h>
+#include <pthread.h>
+
+#include <faux/faux.h>
+
+#include <sysrepo.h>
+
+#include "klish_plugin_sysrepo.h"
+
+
+struct srp_persist_s {
+	sr_session_ctx_t *sess; // Own session. Sessions are not thread-safe
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned long requested; // Generation of the last request
+	unsigned long done; // Generation covered by the last write
+	bool_t failed; // The last write is failed
+	bool_t stop;
+};
+
+
+static void *srp_persist_thread(void *arg)
+{
+	srp_persist_t *persist = (srp_persist_t *)arg;
+	unsigned long target = 0;
+	bool_t failed = BOOL_FALSE;
+
+	pthread_mutex_lock(&persist->mutex);
+	while (BOOL_TRUE) {
+		while (!persist->stop && (persist->done == persist->requested))
+			pthread_cond_wait(&persist->cond, &persist->mutex);
+		// Pending write is finished before stop
+		if (persist->done == persist->requested)
+			break;
+		// All requests made so far are covered by this write
+		target = persist->requested;
+		pthread_mutex_unlock(&persist->mutex);
+
+		failed = BOOL_FALSE;
+		if (sr_copy_config(persist->sess, NULL, SR_DS_RUNNING, 0) !=
+			SR_ERR_OK) {
+			syslog(LOG_ERR, "Can't store data to startup-config");
+			failed = BOOL_TRUE;
+		}
+
+		pthread_mutex_lock(&persist->mutex);
+		persist->done = target;
+		persist->failed = failed;
+		pthread_cond_broadcast(&persist->cond);
+	}
+	pthread_mutex_unlock(&persist->mutex);
+
+	return NULL;
+}
+
+
+srp_persist_t *srp_persist_new(sr_conn_ctx_t *conn)
+{
+	srp_persist_t *persist = NULL;
+
+	assert(conn);
+	if (!conn)
+		return NULL;
+
+	persist = faux_zmalloc(sizeof(*persist));
+	assert(persist);
+	if (!persist)
+		return NULL;
+	persist->requested = 0;
+	persist->done = 0;
+	persist->failed = BOOL_FALSE;
+	persist->stop = BOOL_FALSE;
+
+	if (sr_session_start(conn, SR_DS_STARTUP, &persist->sess) !=
+		SR_ERR_OK) {
+		faux_free(persist);
+		return NULL;
+	}
+	pthread_mutex_init(&persist->mutex, NULL);
+	pthread_cond_init(&persist->cond, NULL);
+	if (pthread_create(&persist->thread, NULL,
+		srp_persist_thread, persist) != 0) {
+		syslog(LOG_ERR, "Can't create startup-config writer thread");
+		pthread_cond_destroy(&persist->cond);
+		pthread_mutex_destroy(&persist->mutex);
+		sr_session_stop(persist->sess);
+		faux_free(persist);
+		return NULL;
+	}
+
+	return persist;
+}
+
+
+// Pending write is finished before return
+void srp_persist_free(srp_persist_t *persist)
+{
+	if (!persist)
+		return;
+
+	pthread_mutex_lock(&persist->mutex);
+	persist->stop = BOOL_TRUE;
+	pthread_cond_broadcast(&persist->cond);
+	pthread_mutex_unlock(&persist->mutex);
+	pthread_join(persist->thread, NULL);
+
+	pthread_cond_destroy(&persist->cond);
+	pthread_mutex_destroy(&persist->mutex);
+	sr_session_stop(persist->sess);
+	faux_free(persist);
+}
+
+
+// Request write and return immediately
+void srp_persist_request(srp_persist_t *persist)
+{
+	assert(persist);
+	if (!persist)
+		return;
+
+	pthread_mutex_lock(&persist->mutex);
+	persist->requested++;
+	pthread_cond_broadcast(&persist->cond);
+	pthread_mutex_unlock(&persist->mutex);
+}
+
+
+// Barrier. Request write and wait for it. The write in progress can miss
+// the latest changes of running-config so the new write is always waited.
+bool_t srp_persist_flush(srp_persist_t *persist)
+{
+	unsigned long gen = 0;
+	bool_t failed = BOOL_FALSE;
+
+	assert(persist);
+	if (!persist)
+		return BOOL_FALSE;
+
+	pthread_mutex_lock(&persist->mutex);
+	gen = ++persist->requested;
+	pthread_cond_broadcast(&persist->cond);
+	while (persist->done < gen)
+		pthread_cond_wait(&persist->cond, &persist->mutex);
+	failed = persist->failed;
+	pthread_mutex_unlock(&persist->mutex);
+
+	return !failed;
+}
+
+
+// The 'pending' means startup-config can differ from running-config. The
+// 'failed' means the last write is failed.
+void srp_persist_status(srp_persist_t *persist, bool_t *pending,
+	bool_t *failed)
+{
+	assert(persist);
+	if (!persist)
+		return;
+
+	pthread_mutex_lock(&persist->mutex);
+	if (pending)
+		*pending = (persist->done != persist->requested);
+	if (failed)
+		*failed = persist->failed;
+	pthread_mutex_unlock(&persist->mutex);
+}
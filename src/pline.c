@@ -139,6 +139,8 @@ static pcompl_t *pcompl_new(void)
 	pcompl->node = NULL;
 	pcompl->xpath = NULL;
 	pcompl->xpath_ds = SRP_REPO_EDIT;
+	pcompl->xpath_opts = 0;
+	pcompl->xpath_timeout = 0;
 	pcompl->pat = PAT_NONE;
 
 	return pcompl;
@@ -167,6 +169,7 @@ pline_t *pline_new(sr_session_ctx_t *sess)
 
 	// Init
 	pline->sess = sess;
+	pline->opts = NULL;
 	pline->invalid = BOOL_FALSE;
 	pline->exprs = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
 		NULL, NULL, (faux_list_free_fn)pexpr_free);
@@ -219,7 +222,7 @@ pexpr_t *pline_current_expr(pline_t *pline)
 }
 
 
-static void pline_add_compl(pline_t *pline,
+static pcompl_t *pline_add_compl(pline_t *pline,
 	pcompl_type_e type, const struct lysc_node *node,
 	const char *xpath, sr_datastore_t ds, pat_e pat)
 {
@@ -236,6 +239,34 @@ static void pline_add_compl(pline_t *pline,
 		pcompl->xpath_ds = ds;
 	}
 	faux_list_add(pline->compls, pcompl);
+
+	return pcompl;
+}
+
+
+// Don't show nodes denied by NACM to user
+static bool_t pline_node_allowed(const pline_t *pline,
+	const struct lysc_node *node)
+{
+	if (!pline->opts || !pline->opts->nacm)
+		return BOOL_TRUE;
+
+	return srp_nacm_node_allowed(pline->opts->nacm, node);
+}
+
+
+static const struct lysc_node *pline_find_child(const pline_t *pline,
+	const struct lysc_node *node, const char *name)
+{
+	const struct lysc_node *child = NULL;
+
+	child = klysc_find_child(node, name);
+	if (!child)
+		return NULL;
+	if (!pline_node_allowed(pline, child))
+		return NULL;
+
+	return child;
 }
 
 
@@ -262,6 +293,10 @@ static void pline_add_compl_subtree(pline_t *pline, const struct lys_module *mod
 			continue;
 		if ((iter->nodetype & LYS_LEAF) && (iter->flags & LYS_KEY))
 			continue;
+		if (!pline_node_allowed(pline, iter))
+			continue;
+		if (klysc_node_ext_is_hidden(iter))
+			continue;
 		if (iter->nodetype & (LYS_CHOICE | LYS_CASE)) {
 			pline_add_compl_subtree(pline, module, iter, xpath);
 			continue;
@@ -501,8 +536,15 @@ static void pline_add_compl_leaf(pline_t *pline, const struct lysc_node *node,
 	if (ext_xpath) {
 		const char *raw_xpath = NULL;
 		sr_datastore_t ds = SRP_REPO_EDIT;
-		if (kly_parse_ext_xpath(ext_xpath, &raw_xpath, &ds))
-			pline_add_compl(pline, PCOMPL_TYPE, NULL, raw_xpath, ds, pat);
+		sr_get_options_t get_opts = 0;
+		uint32_t timeout = 0;
+		if (kly_parse_ext_xpath(ext_xpath, &raw_xpath, &ds,
+			&get_opts, &timeout)) {
+			pcompl_t *pcompl = pline_add_compl(pline, PCOMPL_TYPE,
+				NULL, raw_xpath, ds, pat);
+			pcompl->xpath_opts = get_opts;
+			pcompl->xpath_timeout = timeout;
+		}
 	}
 	pline_add_compl(pline, PCOMPL_TYPE, node, xpath, SRP_REPO_EDIT, pat);
 	pline_add_compl_leafref(pline, node, type, xpath, pat);
@@ -565,7 +607,7 @@ static bool_t pline_parse_module(const struct lys_module *module,
 			}
 
 			// Next element
-			node = klysc_find_child(module->compiled->data, str);
+			node = pline_find_child(pline, module->compiled->data, str);
 			if (!node)
 				break;
 
@@ -582,7 +624,7 @@ static bool_t pline_parse_module(const struct lys_module *module,
 			}
 
 			// Next element
-			node = klysc_find_child(lysc_node_child(node), str);
+			node = pline_find_child(pline, lysc_node_child(node), str);
 
 		// List
 		} else if (node->nodetype & LYS_LIST) {
@@ -753,7 +795,7 @@ static bool_t pline_parse_module(const struct lys_module *module,
 			}
 
 			// Next element
-			node = klysc_find_child(lysc_node_child(node), str);
+			node = pline_find_child(pline, lysc_node_child(node), str);
 
 		// Leaf
 		} else if (node->nodetype & LYS_LEAF) {
@@ -857,7 +899,7 @@ static bool_t pline_parse_module(const struct lys_module *module,
 			}
 
 			// Next element
-			node = klysc_find_child(lysc_node_child(node), str);
+			node = pline_find_child(pline, lysc_node_child(node), str);
 
 		} else {
 			break;
@@ -902,6 +944,7 @@ pline_t *pline_parse(sr_session_ctx_t *sess, const faux_argv_t *argv,
 	pline = pline_new(sess);
 	if (!pline)
 		return NULL;
+	pline->opts = opts;
 	ctx = sr_session_acquire_context(pline->sess);
 	if (!ctx)
 		return NULL;
@@ -935,7 +978,7 @@ pline_t *pline_parse(sr_session_ctx_t *sess, const faux_argv_t *argv,
 }
 
 
-static void identityref_compl(struct lysc_ident *ident)
+static void identityref_compl(struct lysc_ident *ident, srp_sink_t *sink)
 {
 	LY_ARRAY_COUNT_TYPE u = 0;
 
@@ -943,17 +986,17 @@ static void identityref_compl(struct lysc_ident *ident)
 		return;
 
 	if (!ident->derived) {
-		printf("%s\n", ident->name);
+		srp_sink_printf(sink, "%s\n", ident->name);
 		return;
 	}
 
 	LY_ARRAY_FOR(ident->derived, u) {
-		identityref_compl(ident->derived[u]);
+		identityref_compl(ident->derived[u], sink);
 	}
 }
 
 
-static void identityref_help(struct lysc_ident *ident)
+static void identityref_help(struct lysc_ident *ident, srp_sink_t *sink)
 {
 	LY_ARRAY_COUNT_TYPE u = 0;
 
@@ -963,29 +1006,31 @@ static void identityref_help(struct lysc_ident *ident)
 	if (!ident->derived) {
 		if (ident->dsc) {
 			char *dsc = faux_str_getline(ident->dsc, NULL);
-			printf("%s\n%s\n", ident->name, dsc);
+			srp_sink_printf(sink, "%s\n%s\n", ident->name, dsc);
 			faux_str_free(dsc);
 		} else {
-			printf("%s\n%s\n", ident->name, ident->name);
+			srp_sink_printf(sink, "%s\n%s\n",
+				ident->name, ident->name);
 		}
 		return;
 	}
 
 	LY_ARRAY_FOR(ident->derived, u) {
-		identityref_help(ident->derived[u]);
+		identityref_help(ident->derived[u], sink);
 	}
 }
 
 
 
-static void pline_print_type_completions(const struct lysc_type *type)
+static void pline_print_type_completions(const struct lysc_type *type,
+	srp_sink_t *sink)
 {
 	assert(type);
 
 	switch (type->basetype) {
 
 	case LY_TYPE_BOOL: {
-		printf("true\nfalse\n");
+		srp_sink_puts(sink, "true\nfalse\n");
 		break;
 	}
 
@@ -995,7 +1040,7 @@ static void pline_print_type_completions(const struct lysc_type *type)
 		LY_ARRAY_COUNT_TYPE u = 0;
 
 		LY_ARRAY_FOR(t->enums, u) {
-			printf("%s\n",t->enums[u].name);
+			srp_sink_printf(sink, "%s\n",t->enums[u].name);
 		}
 		break;
 	}
@@ -1006,7 +1051,7 @@ static void pline_print_type_completions(const struct lysc_type *type)
 		LY_ARRAY_COUNT_TYPE u = 0;
 
 		LY_ARRAY_FOR(t->bases, u) {
-			identityref_compl(t->bases[u]);
+			identityref_compl(t->bases[u], sink);
 		}
 		break;
 	}
@@ -1017,7 +1062,7 @@ static void pline_print_type_completions(const struct lysc_type *type)
 		LY_ARRAY_COUNT_TYPE u = 0;
 
 		LY_ARRAY_FOR(t->types, u) {
-			pline_print_type_completions(t->types[u]);
+			pline_print_type_completions(t->types[u], sink);
 		}
 		break;
 	}
@@ -1025,7 +1070,7 @@ static void pline_print_type_completions(const struct lysc_type *type)
 	case LY_TYPE_LEAFREF: {
 		struct lysc_type_leafref *t =
 			(struct lysc_type_leafref *)type;
-		pline_print_type_completions(t->realtype);
+		pline_print_type_completions(t->realtype, sink);
 		break;
 	}
 
@@ -1035,7 +1080,8 @@ static void pline_print_type_completions(const struct lysc_type *type)
 }
 
 
-static void uint_range(const struct lysc_type *type, uint64_t def_min, uint64_t def_max)
+static void uint_range(const struct lysc_type *type,
+	uint64_t def_min, uint64_t def_max, srp_sink_t *sink)
 {
 	struct lysc_range *range = NULL;
 	LY_ARRAY_COUNT_TYPE u = 0;
@@ -1046,7 +1092,8 @@ static void uint_range(const struct lysc_type *type, uint64_t def_min, uint64_t
 
 	// Show defaults
 	if (!range) {
-		printf("[%" PRIu64 "..%" PRIu64 "]\n", def_min, def_max);
+		srp_sink_printf(sink, "[%" PRIu64 "..%" PRIu64 "]\n",
+			def_min, def_max);
 		return;
 	}
 
@@ -1062,12 +1109,13 @@ static void uint_range(const struct lysc_type *type, uint64_t def_min, uint64_t
 		faux_str_free(t);
 	}
 	faux_str_cat(&r, "]\n");
-	printf("%s", r);
+	srp_sink_puts(sink, r);
 	faux_free(r);
 }
 
 
-static void int_range(const struct lysc_type *type, int64_t def_min, int64_t def_max)
+static void int_range(const struct lysc_type *type,
+	int64_t def_min, int64_t def_max, srp_sink_t *sink)
 {
 	struct lysc_range *range = NULL;
 	LY_ARRAY_COUNT_TYPE u = 0;
@@ -1078,7 +1126,8 @@ static void int_range(const struct lysc_type *type, int64_t def_min, int64_t def
 
 	// Show defaults
 	if (!range) {
-		printf("[%" PRId64 "..%" PRId64 "]\n", def_min, def_max);
+		srp_sink_printf(sink, "[%" PRId64 "..%" PRId64 "]\n",
+			def_min, def_max);
 		return;
 	}
 
@@ -1094,12 +1143,13 @@ static void int_range(const struct lysc_type *type, int64_t def_min, int64_t def
 		faux_str_free(t);
 	}
 	faux_str_cat(&r, "]\n");
-	printf("%s", r);
+	srp_sink_puts(sink, r);
 	faux_free(r);
 }
 
 
-static void dec_range(const struct lysc_type *type, int64_t def_min, int64_t def_max)
+static void dec_range(const struct lysc_type *type,
+	int64_t def_min, int64_t def_max, srp_sink_t *sink)
 {
 	struct lysc_range *range = NULL;
 	uint8_t fraction_digits = 0;
@@ -1116,7 +1166,7 @@ static void dec_range(const struct lysc_type *type, int64_t def_min, int64_t def
 
 	// Show defaults
 	if (!range) {
-		printf("[%.*f..%.*f]\n",
+		srp_sink_printf(sink, "[%.*f..%.*f]\n",
 			fraction_digits, (double)def_min / div,
 			fraction_digits, (double)def_max / div);
 		return;
@@ -1135,12 +1185,12 @@ static void dec_range(const struct lysc_type *type, int64_t def_min, int64_t def
 		faux_str_free(t);
 	}
 	faux_str_cat(&r, "]\n");
-	printf("%s", r);
+	srp_sink_puts(sink, r);
 	faux_free(r);
 }
 
 
-static void str_range(const struct lysc_type *type)
+static void str_range(const struct lysc_type *type, srp_sink_t *sink)
 {
 	struct lysc_range *range = NULL;
 	LY_ARRAY_COUNT_TYPE u = 0;
@@ -1151,7 +1201,7 @@ static void str_range(const struct lysc_type *type)
 
 	// Show defaults
 	if (!range) {
-		printf("<string>\n");
+		srp_sink_puts(sink, "<string>\n");
 		return;
 	}
 
@@ -1167,13 +1217,13 @@ static void str_range(const struct lysc_type *type)
 		faux_str_free(t);
 	}
 	faux_str_cat(&r, "]>\n");
-	printf("%s", r);
+	srp_sink_puts(sink, r);
 	faux_free(r);
 }
 
 
 static void pline_print_type_help(const struct lysc_node *node,
-	const struct lysc_type *type)
+	const struct lysc_type *type, srp_sink_t *sink)
 {
 	const char *units = NULL;
 
@@ -1188,52 +1238,52 @@ static void pline_print_type_help(const struct lysc_node *node,
 		return;
 
 	if (units) {
-		printf("%s\n", units);
+		srp_sink_printf(sink, "%s\n", units);
 	} else {
 		switch (type->basetype) {
 
 		case LY_TYPE_UINT8:
-			uint_range(type, 0, UCHAR_MAX);
+			uint_range(type, 0, UCHAR_MAX, sink);
 			break;
 
 		case LY_TYPE_UINT16:
-			uint_range(type, 0, USHRT_MAX);
+			uint_range(type, 0, USHRT_MAX, sink);
 			break;
 
 		case LY_TYPE_UINT32:
-			uint_range(type, 0, UINT_MAX);
+			uint_range(type, 0, UINT_MAX, sink);
 			break;
 
 		case LY_TYPE_UINT64:
-			uint_range(type, 0, ULLONG_MAX);
+			uint_range(type, 0, ULLONG_MAX, sink);
 			break;
 
 		case LY_TYPE_INT8:
-			int_range(type, CHAR_MIN, CHAR_MAX);
+			int_range(type, CHAR_MIN, CHAR_MAX, sink);
 			break;
 
 		case LY_TYPE_INT16:
-			int_range(type, SHRT_MIN, SHRT_MAX);
+			int_range(type, SHRT_MIN, SHRT_MAX, sink);
 			break;
 
 		case LY_TYPE_INT32:
-			int_range(type, INT_MIN, INT_MAX);
+			int_range(type, INT_MIN, INT_MAX, sink);
 			break;
 
 		case LY_TYPE_INT64:
-			int_range(type, LLONG_MIN, LLONG_MAX);
+			int_range(type, LLONG_MIN, LLONG_MAX, sink);
 			break;
 
 		case LY_TYPE_DEC64:
-			dec_range(type, LLONG_MIN, LLONG_MAX);
+			dec_range(type, LLONG_MIN, LLONG_MAX, sink);
 			break;
 
 		case LY_TYPE_STRING:
-			str_range(type);
+			str_range(type, sink);
 			break;
 
 		case LY_TYPE_BOOL:
-			printf("<true/false>\n");
+			srp_sink_puts(sink, "<true/false>\n");
 			break;
 
 		case LY_TYPE_LEAFREF: {
@@ -1247,14 +1297,14 @@ static void pline_print_type_help(const struct lysc_node *node,
 			ref_node = lys_find_path(NULL, node, path, 0);
 			faux_str_free(path);
 			if (!ref_node) {
-				pline_print_type_help(node, t->realtype);
+				pline_print_type_help(node, t->realtype, sink);
 				return; // Because it prints whole info itself
 			}
 			if (ref_node->nodetype & LYS_LEAF)
 				ref_type = ((struct lysc_node_leaf *)ref_node)->type;
 			else
 				ref_type = ((struct lysc_node_leaflist *)ref_node)->type;
-			pline_print_type_help(ref_node, ref_type);
+			pline_print_type_help(ref_node, ref_type, sink);
 			return; // Because it prints whole info itself
 		}
 
@@ -1263,7 +1313,7 @@ static void pline_print_type_help(const struct lysc_node *node,
 				(const struct lysc_type_union *)type;
 			LY_ARRAY_COUNT_TYPE u = 0;
 			LY_ARRAY_FOR(t->types, u)
-				pline_print_type_help(node, t->types[u]);
+				pline_print_type_help(node, t->types[u], sink);
 			return; // Because it prints whole info itself
 		}
 
@@ -1275,11 +1325,11 @@ static void pline_print_type_help(const struct lysc_node *node,
 				if (t->enums[u].dsc) {
 					char *dsc = faux_str_getline(
 						t->enums[u].dsc, NULL);
-					printf("%s\n%s\n",
+					srp_sink_printf(sink, "%s\n%s\n",
 						t->enums[u].name, dsc);
 					faux_str_free(dsc);
 				} else {
-					printf("%s\n%s\n",
+					srp_sink_printf(sink, "%s\n%s\n",
 						t->enums[u].name,
 						t->enums[u].name);
 				}
@@ -1291,22 +1341,22 @@ static void pline_print_type_help(const struct lysc_node *node,
 				(struct lysc_type_identityref *)type;
 			LY_ARRAY_COUNT_TYPE u = 0;
 			LY_ARRAY_FOR(t->bases, u)
-				identityref_help(t->bases[u]);
+				identityref_help(t->bases[u], sink);
 			return; // Because it prints whole info itself
 		}
 
 		default:
-			printf("<unknown>\n");
+			srp_sink_puts(sink, "<unknown>\n");
 			break;
 		}
 	}
 
 	if (node->dsc) {
 		char *dsc = faux_str_getline(node->dsc, NULL);
-		printf("%s\n", dsc);
+		srp_sink_printf(sink, "%s\n", dsc);
 		faux_str_free(dsc);
 	} else {
-		printf("%s\n", node->name);
+		srp_sink_printf(sink, "%s\n", node->name);
 	}
 }
 
@@ -1321,7 +1371,8 @@ static bool_t pline_find_node_within_tree(const struct lyd_node *nodes_list,
 
 	LY_LIST_FOR(nodes_list, iter) {
 		const char *default_value = NULL;
-		char *value = NULL;
+		const char *value = NULL;
+		char *escaped = NULL;
 
 		if (iter->schema != node) {
 			if (pline_find_node_within_tree(lyd_child(iter),
@@ -1333,13 +1384,13 @@ static bool_t pline_find_node_within_tree(const struct lyd_node *nodes_list,
 			continue;
 		}
 		default_value = klysc_node_ext_default(iter->schema);
-		value = klyd_node_value(iter);
+		value = klyd_node_value_ref(iter, &escaped);
 		// Don't show "default" keys with default values
 		if (default_value && faux_str_cmp(default_value, value) == 0) {
-			faux_str_free(value);
+			faux_str_free(escaped);
 			continue;
 		}
-		faux_str_free(value);
+		faux_str_free(escaped);
 		return BOOL_TRUE;
 	}
 
@@ -1369,7 +1420,7 @@ static bool_t pline_node_exists(sr_session_ctx_t* sess, const char *xpath,
 
 
 void pline_print_completions(const pline_t *pline, bool_t help,
-	pt_e enabled_types, bool_t existing_nodes_only)
+	pt_e enabled_types, bool_t existing_nodes_only, srp_sink_t *sink)
 {
 	faux_list_node_t *iter = NULL;
 	pcompl_t *pcompl = NULL;
@@ -1404,7 +1455,7 @@ void pline_print_completions(const pline_t *pline, bool_t help,
 					type = ((struct lysc_node_leaflist *)node)->type;
 				else
 					continue;
-				pline_print_type_help(node, type);
+				pline_print_type_help(node, type, sink);
 				continue;
 			}
 
@@ -1417,11 +1468,11 @@ void pline_print_completions(const pline_t *pline, bool_t help,
 
 			// Node (help)
 			if (!node->dsc) {
-				printf("%s\n%s\n", node->name, node->name);
+				srp_sink_printf(sink, "%s\n%s\n", node->name, node->name);
 			} else {
 				char *dsc = faux_str_getline(node->dsc,
 					NULL);
-				printf("%s\n%s\n", node->name, dsc);
+				srp_sink_printf(sink, "%s\n%s\n", node->name, dsc);
 				faux_str_free(dsc);
 			}
 
@@ -1436,9 +1487,17 @@ void pline_print_completions(const pline_t *pline, bool_t help,
 					size_t i = 0;
 					sr_val_t *vals = NULL;
 					size_t val_num = 0;
+					uint32_t timeout = pcompl->xpath_timeout;
+					uint32_t latency = 0;
 
-					sr_get_items(pline->sess, pcompl->xpath,
-						0, 0, &vals, &val_num);
+					if (pline->opts) {
+						if (!timeout)
+							timeout = pline->opts->compl_timeout;
+						latency = pline->opts->compl_latency;
+					}
+					kly_get_items(pline->sess, pcompl->xpath,
+						pcompl->xpath_opts, timeout, latency,
+						&vals, &val_num);
 					for (i = 0; i < val_num; i++) {
 						char *tmp = sr_val_to_str(&vals[i]);
 						char *esc_tmp = NULL;
@@ -1446,7 +1505,7 @@ void pline_print_completions(const pline_t *pline, bool_t help,
 							continue;
 						esc_tmp = faux_str_c_esc_space(tmp);
 						free(tmp);
-						printf("%s\n", esc_tmp);
+						srp_sink_printf(sink, "%s\n", esc_tmp);
 						free(esc_tmp);
 					}
 					sr_free_values(vals, val_num);
@@ -1464,7 +1523,7 @@ void pline_print_completions(const pline_t *pline, bool_t help,
 					type = ((struct lysc_node_leaflist *)node)->type;
 				else
 					continue;
-				pline_print_type_completions(type);
+				pline_print_type_completions(type, sink);
 				continue;
 			}
 
@@ -1479,7 +1538,7 @@ void pline_print_completions(const pline_t *pline, bool_t help,
 					continue;
 			}
 
-			printf("%s\n", node->name);
+			srp_sink_printf(sink, "%s\n", node->name);
 
 		} // Completion
 
@@ -1506,6 +1565,30 @@ void pline_opts_init(pline_opts_t *opts)
 	opts->hide_passwords = BOOL_TRUE;
 	opts->enable_nacm = BOOL_FALSE;
 	opts->oneliners = BOOL_TRUE;
+	opts->compl_timeout = 0;
+	opts->compl_latency = 300;
+	opts->show_depth = 0;
+	opts->show_chunk = 0;
+	opts->show_threads = 1;
+	opts->show_cache_dir = NULL;
+	opts->diff_journal = BOOL_FALSE;
+	opts->incremental_commit = BOOL_FALSE;
+	opts->write_behind = BOOL_FALSE;
+	opts->deferred_apply = BOOL_FALSE;
+	opts->deferred_limit = 100;
+	opts->nacm = NULL;
+	opts->show_depth_base = 0;
+	opts->show_sess = NULL;
+	opts->show_display = SHOW_DISPLAY_TEXT;
+	opts->show_match = NULL;
+	opts->show_except = NULL;
+	opts->show_count = BOOL_FALSE;
+	opts->show_last = 0;
+	opts->show_first = 0;
+	opts->show_skip = 0;
+	opts->show_from = NULL;
+	opts->show_to = NULL;
+	opts->show_state = BOOL_FALSE;
 }
 
 
@@ -1594,6 +1677,77 @@ static int pline_opts_parse_ini(const faux_ini_t *ini, pline_opts_t *opts)
 			opts->oneliners = BOOL_FALSE;
 	}
 
+	if ((val = faux_ini_find(ini, "CompletionTimeout"))) {
+		unsigned int timeout = 0;
+		if (faux_conv_atoui(val, &timeout, 10))
+			opts->compl_timeout = timeout;
+	}
+
+	if ((val = faux_ini_find(ini, "CompletionLatency"))) {
+		unsigned int latency = 0;
+		if (faux_conv_atoui(val, &latency, 10))
+			opts->compl_latency = latency;
+	}
+
+	if ((val = faux_ini_find(ini, "ShowDepth"))) {
+		unsigned int depth = 0;
+		if (faux_conv_atoui(val, &depth, 10))
+			opts->show_depth = depth;
+	}
+
+	if ((val = faux_ini_find(ini, "ShowChunkSize"))) {
+		unsigned int chunk = 0;
+		if (faux_conv_atoui(val, &chunk, 10))
+			opts->show_chunk = chunk;
+	}
+
+	if ((val = faux_ini_find(ini, "ShowThreads"))) {
+		unsigned int threads = 0;
+		if (faux_conv_atoui(val, &threads, 10) && (threads > 0))
+			opts->show_threads = threads;
+	}
+
+	if ((val = faux_ini_find(ini, "ShowCacheDir"))) {
+		faux_str_free(opts->show_cache_dir);
+		opts->show_cache_dir = NULL;
+		if (!faux_str_is_empty(val))
+			opts->show_cache_dir = faux_str_dup(val);
+	}
+
+	if ((val = faux_ini_find(ini, "DiffJournal"))) {
+		if (faux_str_cmp(val, "y") == 0)
+			opts->diff_journal = BOOL_TRUE;
+		else if (faux_str_cmp(val, "n") == 0)
+			opts->diff_journal = BOOL_FALSE;
+	}
+
+	if ((val = faux_ini_find(ini, "IncrementalCommit"))) {
+		if (faux_str_cmp(val, "y") == 0)
+			opts->incremental_commit = BOOL_TRUE;
+		else if (faux_str_cmp(val, "n") == 0)
+			opts->incremental_commit = BOOL_FALSE;
+	}
+
+	if ((val = faux_ini_find(ini, "WriteBehind"))) {
+		if (faux_str_cmp(val, "y") == 0)
+			opts->write_behind = BOOL_TRUE;
+		else if (faux_str_cmp(val, "n") == 0)
+			opts->write_behind = BOOL_FALSE;
+	}
+
+	if ((val = faux_ini_find(ini, "DeferredApply"))) {
+		if (faux_str_cmp(val, "y") == 0)
+			opts->deferred_apply = BOOL_TRUE;
+		else if (faux_str_cmp(val, "n") == 0)
+			opts->deferred_apply = BOOL_FALSE;
+	}
+
+	if ((val = faux_ini_find(ini, "DeferredApplyLimit"))) {
+		unsigned int limit = 0;
+		if (faux_conv_atoui(val, &limit, 10))
+			opts->deferred_limit = limit;
+	}
+
 	return 0;
 }
 
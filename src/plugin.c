@@ -3,6 +3,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <assert.h>
 #include <syslog.h>
@@ -33,6 +34,7 @@ static bool_t free_udata(void *data)
 	assert(udata);
 	if (udata->path)
 		faux_argv_free(udata->path);
+	faux_str_free(udata->opts.show_cache_dir);
 	faux_free(udata);
 
 	return BOOL_TRUE;
@@ -137,12 +139,29 @@ int kplugin_sysrepo_init(kcontext_t *context)
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("srp_reset", srp_reset,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("srp_save", srp_save,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("srp_begin", srp_begin,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("srp_flush", srp_flush,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
+	// Applies deferred edits before async symbols. Child process can't
+	// use parent's session
+	kplugin_add_syms(plugin, ksym_new_ext("srp_apply", srp_apply,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("srp_show_abs", srp_show_abs,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("srp_show", srp_show,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("srp_diff", srp_diff,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
+	// Async variants are executed within forked process
+	kplugin_add_syms(plugin, ksym_new_ext("srp_show_abs_async", srp_show_abs_async,
+		KSYM_USERDEFINED_PERMANENT, KSYM_UNSYNC, KSYM_NONSILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("srp_show_async", srp_show_async,
+		KSYM_USERDEFINED_PERMANENT, KSYM_UNSYNC, KSYM_NONSILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("srp_diff_async", srp_diff_async,
+		KSYM_USERDEFINED_PERMANENT, KSYM_UNSYNC, KSYM_NONSILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("srp_deactivate", srp_deactivate,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 
@@ -153,10 +172,17 @@ int kplugin_sysrepo_init(kcontext_t *context)
 	udata->sr_conn = NULL;
 	udata->sr_sess = NULL;
 	udata->nacm_sub = NULL;
+	udata->nacm = NULL;
+	udata->cache = NULL;
+	udata->journal = NULL;
+	udata->persist = NULL;
 
 	// Settings
 	pline_opts_init(&udata->opts);
 	pline_opts_parse(kplugin_conf(plugin), &udata->opts);
+	udata->deferred = udata->opts.deferred_apply;
+	udata->deferred_num = 0;
+	udata->startup_synced = BOOL_FALSE;
 
 	if (!kscheme_named_udata_new(scheme, SRP_UDATA_NAME, udata, free_udata))
 		syslog(LOG_ERR, "Can't create name udata \"%s\"", SRP_UDATA_NAME);
@@ -263,6 +289,21 @@ static bool_t kplugin_sysrepo_connect(kcontext_t *context)
 			return BOOL_FALSE;
 		}
 		sr_nacm_set_user(udata->sr_sess, user);
+		// Schema view to hide denied nodes from parser and completion
+		udata->nacm = srp_nacm_new(udata->sr_conn, user);
+		udata->opts.nacm = udata->nacm;
+	}
+	// Rendered output depends on NACM user so it's not shared
+	if (udata->opts.show_cache_dir && !udata->opts.enable_nacm)
+		udata->cache = srp_cache_new(udata->sr_conn,
+			udata->opts.show_cache_dir);
+	if (udata->opts.diff_journal)
+		udata->journal = srp_journal_new(udata->sr_conn,
+			sr_session_get_id(udata->sr_sess));
+	if (udata->opts.write_behind) {
+		udata->persist = srp_persist_new(udata->sr_conn);
+		if (!udata->persist)
+			syslog(LOG_WARNING, "Can't start write-behind of startup-config");
 	}
 
 	syslog(LOG_INFO, "Start SysRepo session for \"%s\"", user);
@@ -271,6 +312,62 @@ static bool_t kplugin_sysrepo_connect(kcontext_t *context)
 }
 
 
+// Async symbols are executed within forked process. The Sysrepo connection
+// of parent process can't be used after fork() so own connection is
+// created.
+bool_t srp_async_connect(kcontext_t *context, srp_async_t *async)
+{
+	srp_udata_t *udata = NULL;
+	const char *user = NULL;
+
+	assert(context);
+	assert(async);
+
+	udata = srp_udata(context);
+	assert(udata);
+	memset(async, 0, sizeof(*async));
+
+	user = ksession_user(kcontext_session(context));
+	if (sr_connect(SR_CONN_DEFAULT, &async->sr_conn)) {
+		async->sr_conn = NULL;
+		fprintf(stderr, "Error: Can't connect to config storage\n");
+		return BOOL_FALSE;
+	}
+	if (sr_session_start(async->sr_conn, SRP_REPO_EDIT, &async->sr_sess)) {
+		srp_async_disconnect(async);
+		fprintf(stderr, "Error: Can't connect to config storage\n");
+		return BOOL_FALSE;
+	}
+	sr_session_set_orig_name(async->sr_sess, user);
+	if (udata->opts.enable_nacm) {
+		if (sr_nacm_init(async->sr_sess, 0, &async->nacm_sub) !=
+			SR_ERR_OK) {
+			srp_async_disconnect(async);
+			fprintf(stderr, "Error: Can't init NACM\n");
+			return BOOL_FALSE;
+		}
+		async->nacm = BOOL_TRUE;
+		sr_nacm_set_user(async->sr_sess, user);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+void srp_async_disconnect(srp_async_t *async)
+{
+	if (!async || !async->sr_conn)
+		return;
+
+	if (async->nacm) {
+		sr_unsubscribe(async->nacm_sub);
+		sr_nacm_destroy();
+	}
+	sr_disconnect(async->sr_conn);
+	memset(async, 0, sizeof(*async));
+}
+
+
 sr_session_ctx_t *srp_udata_sr_sess(kcontext_t *context)
 {
 	srp_udata_t *udata = NULL;
@@ -294,6 +391,49 @@ sr_session_ctx_t *srp_udata_sr_sess(kcontext_t *context)
 }
 
 
+// Cache is created on connection to Sysrepo
+srp_cache_t *srp_udata_cache(kcontext_t *context)
+{
+	srp_udata_t *udata = NULL;
+
+	assert(context);
+
+	udata = srp_udata(context);
+	assert(udata);
+
+	return udata->cache;
+}
+
+
+// Journal is created on connection to Sysrepo
+srp_journal_t *srp_udata_journal(kcontext_t *context)
+{
+	srp_udata_t *udata = NULL;
+
+	assert(context);
+
+	udata = srp_udata(context);
+	assert(udata);
+
+	return udata->journal;
+}
+
+
+// Background writer is created on connection to Sysrepo. NULL means
+// startup-config is written synchronously
+srp_persist_t *srp_udata_persist(kcontext_t *context)
+{
+	srp_udata_t *udata = NULL;
+
+	assert(context);
+
+	udata = srp_udata(context);
+	assert(udata);
+
+	return udata->persist;
+}
+
+
 static int kplugin_sysrepo_init_session(kcontext_t *context)
 {
 	context = context; // Happy compiler
@@ -315,7 +455,24 @@ static int kplugin_sysrepo_fini_session(kcontext_t *context)
 	if (udata->sr_conn) {
 		const char *user = NULL;
 
+		// Deferred edits are lost on disconnect
+		if (sr_has_changes(udata->sr_sess) &&
+			(sr_apply_changes(udata->sr_sess, 0) != SR_ERR_OK))
+			syslog(LOG_ERR, "Can't apply deferred changes");
+		udata->deferred_num = 0;
+
+		srp_cache_free(udata->cache);
+		udata->cache = NULL;
+		srp_journal_free(udata->journal);
+		udata->journal = NULL;
+		// Pending write of startup-config is finished
+		srp_persist_free(udata->persist);
+		udata->persist = NULL;
+
 		if (udata->opts.enable_nacm) {
+			udata->opts.nacm = NULL;
+			srp_nacm_free(udata->nacm);
+			udata->nacm = NULL;
 			sr_unsubscribe(udata->nacm_sub);
 			sr_nacm_destroy();
 		}
@@ -4,6 +4,10 @@
 #include <string.h>
 #include <assert.h>
 #include <syslog.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <regex.h>
 
 #include <faux/faux.h>
 #include <faux/str.h>
@@ -19,15 +23,24 @@
 
 
 static void show_container(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner);
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink);
 static void show_list(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner);
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink);
 static void show_leaf(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner);
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink);
 static void show_leaflist(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner);
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink);
 static void show_node(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner);
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink);
+static void show_state(const struct lyd_node *nodes_list, size_t level,
+	pline_opts_t *opts, srp_sink_t *sink);
+static bool_t show_has_state(const struct lyd_node *nodes_list,
+	pline_opts_t *opts);
 static enum diff_op str2diff_op(const char *str);
 
 
@@ -55,22 +68,68 @@ static const char *diff_suffix(enum diff_op op, pline_opts_t *opts)
 }
 
 
+// Children of node are deeper than requested depth
+static bool_t show_is_collapsed(const struct lyd_node *node, pline_opts_t *opts)
+{
+	const struct lyd_node *iter = NULL;
+	size_t depth = 0;
+
+	if (0 == opts->show_depth)
+		return BOOL_FALSE;
+
+	for (iter = node; iter; iter = lyd_parent(iter))
+		depth++;
+
+	return (depth >= (opts->show_depth_base + opts->show_depth));
+}
+
+
+// Show marker with number of children instead of collapsed subtree
+static void show_collapsed(const struct lyd_node *node, enum diff_op op,
+	pline_opts_t *opts, srp_sink_t *sink)
+{
+	size_t num = klyd_visible_child_num(node);
+
+	if (opts->show_brackets)
+		srp_sink_printf(sink, " %c ... (%zu) %c%s\n",
+			opts->begin_bracket, num, opts->end_bracket,
+			diff_suffix(op, opts));
+	else
+		srp_sink_printf(sink, " ... (%zu)%s\n",
+			num, diff_suffix(op, opts));
+}
+
+
 static void show_container(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink)
 {
 	char begin_bracket[3] = {' ', opts->begin_bracket, '\0'};
+	const struct lyd_node *first_child = NULL;
 	size_t child_num = 0;
 	bool_t show_brackets = BOOL_FALSE;
 	bool_t node_is_oneliner = BOOL_FALSE;
+	bool_t has_state = BOOL_FALSE;
 
 	if (!node)
 		return;
 
-	child_num = klyd_visible_child_num(node);
-	node_is_oneliner = opts->oneliners && (child_num == 1);
-	show_brackets = opts->show_brackets && !node_is_oneliner && (child_num != 0);
+	first_child = klyd_visible_child_first(node, &child_num);
+	if ((child_num != 0) && show_is_collapsed(node, opts)) {
+		srp_sink_printf(sink, "%s%*s%s",
+			diff_prefix(op, opts),
+			parent_is_oneliner ? 1 : (int)(level * opts->indent), "",
+			node->schema->name);
+		show_collapsed(node, op, opts, sink);
+		return;
+	}
+	// State is shown by comment lines so node with state is not oneliner
+	has_state = show_has_state(lyd_child(node), opts);
+	node_is_oneliner = opts->oneliners && (child_num == 1) && !has_state;
+	show_brackets = opts->show_brackets && !node_is_oneliner &&
+		((child_num != 0) || has_state);
 
-	printf("%s%*s%s%s%s%s",
+	srp_sink_printf(sink, "%s%*s%s%s%s%s",
 		diff_prefix(op, opts),
 		parent_is_oneliner ? 1 : (int)(level * opts->indent), "",
 		node->schema->name,
@@ -78,11 +137,12 @@ static void show_container(const struct lyd_node *node, size_t level,
 		diff_suffix(op, opts),
 		node_is_oneliner ? "" : "\n");
 	if (child_num != 0)
-		show_subtree(lyd_child(node),
+		show_subtree(first_child,
 			node_is_oneliner ? level : (level + 1),
-			op, opts, node_is_oneliner);
+			op, opts, node_is_oneliner, sink);
+	show_state(lyd_child(node), level + 1, opts, sink);
 	if (show_brackets) {
-		printf("%s%*s%c%s\n",
+		srp_sink_printf(sink, "%s%*s%c%s\n",
 			diff_prefix(op, opts),
 			(int)(level * opts->indent), "",
 			opts->end_bracket,
@@ -91,64 +151,90 @@ static void show_container(const struct lyd_node *node, size_t level,
 }
 
 
-static void show_list(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
+// Show keys of list entry. The KeysWithStatement, FirstKeyWithStatement and
+// DefaultKeys settings are used so output can be parsed back
+static void show_list_keys(const struct lyd_node *node, pline_opts_t *opts,
+	srp_sink_t *sink)
 {
-	char begin_bracket[3] = {' ', opts->begin_bracket, '\0'};
 	const struct lyd_node *iter = NULL;
 	bool_t first_key = BOOL_TRUE;
 	const char *default_value = NULL;
-	size_t child_num = 0;
-	bool_t show_brackets = BOOL_FALSE;
-	bool_t node_is_oneliner = BOOL_FALSE;
-
-	if (!node)
-		return;
-
-	child_num = klyd_visible_child_num(node);
-	node_is_oneliner = opts->oneliners && (child_num == 1);
-	show_brackets = opts->show_brackets && !node_is_oneliner && (child_num != 0);
-
-	printf("%s%*s%s",
-		diff_prefix(op, opts),
-		parent_is_oneliner ? 1 : (int)(level * opts->indent), "",
-		node->schema->name);
 
 	LY_LIST_FOR(lyd_child(node), iter) {
-		char *value = NULL;
+		const char *value = NULL;
+		char *escaped = NULL;
 
+		// Keys are always the first children of list entry
 		if (!(iter->schema->nodetype & LYS_LEAF))
-			continue;
+			break;
 		if (!(iter->schema->flags & LYS_KEY))
-			continue;
+			break;
 
 		default_value = klysc_node_ext_default(iter->schema);
-		value = klyd_node_value(iter);
+		value = klyd_node_value_ref(iter, &escaped);
 		// Don't show "default" keys with default values
 		if (opts->default_keys &&
 			!opts->show_default_keys && default_value &&
 			(faux_str_cmp(default_value, value) == 0)) {
-			faux_str_free(value);
+			faux_str_free(escaped);
 			continue;
 		}
 		if (opts->keys_w_stmt && (!first_key || (first_key &&
 			(opts->first_key_w_stmt ||
 			(opts->default_keys && default_value)))))
-			printf(" %s", iter->schema->name);
-		printf(" %s", value);
-		faux_str_free(value);
+			srp_sink_printf(sink, " %s", iter->schema->name);
+		srp_sink_puts(sink, " ");
+		srp_sink_puts(sink, value);
+		faux_str_free(escaped);
 		first_key = BOOL_FALSE;
 	}
-	printf("%s%s%s",
+}
+
+
+static void show_list(const struct lyd_node *node, size_t level,
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink)
+{
+	char begin_bracket[3] = {' ', opts->begin_bracket, '\0'};
+	const struct lyd_node *first_child = NULL;
+	size_t child_num = 0;
+	bool_t show_brackets = BOOL_FALSE;
+	bool_t node_is_oneliner = BOOL_FALSE;
+	bool_t collapsed = BOOL_FALSE;
+	bool_t has_state = BOOL_FALSE;
+
+	if (!node)
+		return;
+
+	first_child = klyd_visible_child_first(node, &child_num);
+	collapsed = (child_num != 0) && show_is_collapsed(node, opts);
+	// State is shown by comment lines so node with state is not oneliner
+	has_state = show_has_state(lyd_child(node), opts);
+	node_is_oneliner = opts->oneliners && (child_num == 1) && !has_state;
+	show_brackets = opts->show_brackets && !node_is_oneliner &&
+		((child_num != 0) || has_state);
+
+	srp_sink_printf(sink, "%s%*s%s",
+		diff_prefix(op, opts),
+		parent_is_oneliner ? 1 : (int)(level * opts->indent), "",
+		node->schema->name);
+
+	show_list_keys(node, opts, sink);
+	if (collapsed) {
+		show_collapsed(node, op, opts, sink);
+		return;
+	}
+	srp_sink_printf(sink, "%s%s%s",
 		show_brackets ? begin_bracket : "",
 		diff_suffix(op, opts),
 		node_is_oneliner ? "" : "\n");
 	if (child_num != 0)
-		show_subtree(lyd_child(node),
+		show_subtree(first_child,
 			node_is_oneliner ? level : (level + 1),
-			op, opts, node_is_oneliner);
+			op, opts, node_is_oneliner, sink);
+	show_state(lyd_child(node), level + 1, opts, sink);
 	if (show_brackets) {
-		printf("%s%*s%c%s\n",
+		srp_sink_printf(sink, "%s%*s%c%s\n",
 			diff_prefix(op, opts),
 			(int)(level * opts->indent), "",
 			opts->end_bracket,
@@ -158,7 +244,8 @@ static void show_list(const struct lyd_node *node, size_t level,
 
 
 static void show_leaf(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink)
 {
 	struct lysc_node_leaf *leaf = (struct lysc_node_leaf *)node;
 
@@ -167,7 +254,7 @@ static void show_leaf(const struct lyd_node *node, size_t level,
 	if (node->schema->flags & LYS_KEY)
 		return;
 
-	printf("%s%*s%s",
+	srp_sink_printf(sink, "%s%*s%s",
 		diff_prefix(op, opts),
 		parent_is_oneliner ? 1 : (int)(level * opts->indent), "",
 		node->schema->name);
@@ -176,42 +263,122 @@ static void show_leaf(const struct lyd_node *node, size_t level,
 	if (leaf->type->basetype != LY_TYPE_EMPTY) {
 		if (opts->hide_passwords &&
 			klysc_node_ext_is_password(node->schema)) {
-			printf(" <hidden>");
+			srp_sink_puts(sink, " <hidden>");
 		} else {
-			char *value = klyd_node_value(node);
-			printf(" %s", value);
-			faux_str_free(value);
+			char *escaped = NULL;
+			const char *value = klyd_node_value_ref(node, &escaped);
+			srp_sink_puts(sink, " ");
+			srp_sink_puts(sink, value);
+			faux_str_free(escaped);
 		}
 	}
 
-	printf("%s%s\n",
+	srp_sink_printf(sink, "%s%s\n",
 		opts->show_semicolons ? ";" : "",
 		diff_suffix(op, opts));
 }
 
 
 static void show_leaflist(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink)
 {
-	char *value = NULL;
+	const char *value = NULL;
+	char *escaped = NULL;
 
 	if (!node)
 		return;
 
-	value = klyd_node_value(node);
-	printf("%s%*s%s %s%s%s\n",
+	value = klyd_node_value_ref(node, &escaped);
+	srp_sink_printf(sink, "%s%*s%s %s%s%s\n",
 		diff_prefix(op, opts),
 		parent_is_oneliner ? 1 : (int)(level * opts->indent), "",
 		node->schema->name,
 		value,
 		opts->show_semicolons ? ";" : "",
 		diff_suffix(op, opts));
-	faux_str_free(value);
+	faux_str_free(escaped);
+}
+
+
+static bool_t show_is_state_node(const struct lyd_node *node)
+{
+	const struct lysc_node *schema = node->schema;
+
+	if (!schema)
+		return BOOL_FALSE;
+	if (schema->flags & (LYS_CONFIG_W | LYS_KEY))
+		return BOOL_FALSE;
+	if (!(schema->nodetype & SRP_NODETYPE_CONF))
+		return BOOL_FALSE;
+	if (klysc_node_ext_is_hidden(schema))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// Node has state children to show
+static bool_t show_has_state(const struct lyd_node *nodes_list,
+	pline_opts_t *opts)
+{
+	const struct lyd_node *iter = NULL;
+
+	if (!opts->show_state)
+		return BOOL_FALSE;
+
+	LY_LIST_FOR(nodes_list, iter) {
+		if (show_is_state_node(iter))
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// State data merged into configuration tree. It's shown as comments so
+// the output still can be parsed back. The state is shown within brackets
+// of parent node.
+static void show_state(const struct lyd_node *nodes_list, size_t level,
+	pline_opts_t *opts, srp_sink_t *sink)
+{
+	const struct lyd_node *iter = NULL;
+
+	if (!opts->show_state)
+		return;
+
+	LY_LIST_FOR(nodes_list, iter) {
+		const struct lysc_node *schema = iter->schema;
+
+		if (!show_is_state_node(iter))
+			continue;
+
+		srp_sink_printf(sink, "%s%*s# %s",
+			opts->colorize ? "\x1b[2m" : "",
+			(int)(level * opts->indent), "",
+			schema->name);
+		if (schema->nodetype & LYS_LIST) {
+			show_list_keys(iter, opts, sink);
+		} else if ((schema->nodetype & LYS_LEAFLIST) ||
+			((schema->nodetype & LYS_LEAF) &&
+			(((struct lysc_node_leaf *)schema)->type->basetype !=
+			LY_TYPE_EMPTY))) {
+			char *escaped = NULL;
+			srp_sink_puts(sink, " ");
+			srp_sink_puts(sink, klyd_node_value_ref(iter, &escaped));
+			faux_str_free(escaped);
+		}
+		srp_sink_printf(sink, "%s\n", opts->colorize ? "\x1b[0m" : "");
+
+		if (schema->nodetype & (LYS_CONTAINER | LYS_LIST))
+			show_state(lyd_child(iter), level + 1, opts, sink);
+	}
 }
 
 
 static void show_node(const struct lyd_node *node, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink)
 {
 	const struct lysc_node *schema = NULL;
 	struct lyd_meta *meta = NULL;
@@ -229,6 +396,8 @@ static void show_node(const struct lyd_node *node, size_t level,
 		return;
 	if (!(schema->flags & LYS_CONFIG_W))
 		return;
+	if (klysc_node_ext_is_hidden(schema))
+		return;
 
 	meta = lyd_find_meta(node->meta, NULL, "yang:operation");
 	if (meta)
@@ -236,19 +405,21 @@ static void show_node(const struct lyd_node *node, size_t level,
 
 	// Container
 	if (schema->nodetype & LYS_CONTAINER) {
-		show_container(node, level, cur_op, opts, parent_is_oneliner);
+		show_container(node, level, cur_op, opts,
+			parent_is_oneliner, sink);
 
 	// List
 	} else if (schema->nodetype & LYS_LIST) {
-		show_list(node, level, cur_op, opts, parent_is_oneliner);
+		show_list(node, level, cur_op, opts, parent_is_oneliner, sink);
 
 	// Leaf
 	} else if (schema->nodetype & LYS_LEAF) {
-		show_leaf(node, level, cur_op, opts, parent_is_oneliner);
+		show_leaf(node, level, cur_op, opts, parent_is_oneliner, sink);
 
 	// Leaf-list
 	} else if (schema->nodetype & LYS_LEAFLIST) {
-		show_leaflist(node, level, cur_op, opts, parent_is_oneliner);
+		show_leaflist(node, level, cur_op, opts,
+			parent_is_oneliner, sink);
 
 	} else {
 		return;
@@ -256,146 +427,1690 @@ static void show_node(const struct lyd_node *node, size_t level,
 }
 
 
-static void show_sorted_list(faux_list_t *list, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
-{
-	faux_list_node_t *iter = NULL;
-	const struct lyd_node *lyd = NULL;
+// Type of precomputed sort key
+typedef enum {
+	SHOW_KEY_INT,
+	SHOW_KEY_UINT,
+	SHOW_KEY_IP4,
+	SHOW_KEY_IP6,
+	SHOW_KEY_STR,
+} show_key_type_e;
+
+
+// Precomputed sort key of ordered-by system list or leaf-list entry
+typedef struct {
+	show_key_type_e type;
+	union {
+		int64_t i;
+		uint64_t u;
+		uint8_t ip[16];
+	} v;
+	const char *str;
+} show_key_t;
+
+
+typedef struct {
+	const struct lyd_node *node;
+	show_key_t *keys;
+	size_t keys_num;
+	size_t pos; // Original position to make sorting stable
+} show_entry_t;
+
 
-	if (!list)
+static void show_key_init(show_key_t *key, const struct lyd_node *node)
+{
+	const struct lyd_value *value = &((const struct lyd_node_term *)node)->value;
+
+	key->str = lyd_get_value(node);
+	if (!key->str)
+		key->str = "";
+	if ((LY_TYPE_UNION == value->realtype->basetype) && value->subvalue)
+		value = &value->subvalue->value;
+
+	switch (value->realtype->basetype) {
+	case LY_TYPE_INT8:
+		key->type = SHOW_KEY_INT;
+		key->v.i = value->int8;
+		return;
+	case LY_TYPE_INT16:
+		key->type = SHOW_KEY_INT;
+		key->v.i = value->int16;
+		return;
+	case LY_TYPE_INT32:
+		key->type = SHOW_KEY_INT;
+		key->v.i = value->int32;
+		return;
+	case LY_TYPE_INT64:
+		key->type = SHOW_KEY_INT;
+		key->v.i = value->int64;
+		return;
+	case LY_TYPE_DEC64:
+		key->type = SHOW_KEY_INT;
+		key->v.i = value->dec64;
+		return;
+	case LY_TYPE_UINT8:
+		key->type = SHOW_KEY_UINT;
+		key->v.u = value->uint8;
+		return;
+	case LY_TYPE_UINT16:
+		key->type = SHOW_KEY_UINT;
+		key->v.u = value->uint16;
+		return;
+	case LY_TYPE_UINT32:
+		key->type = SHOW_KEY_UINT;
+		key->v.u = value->uint32;
 		return;
+	case LY_TYPE_UINT64:
+		key->type = SHOW_KEY_UINT;
+		key->v.u = value->uint64;
+		return;
+	default:
+		break;
+	}
+
+	// Strings can contain IP addresses
+	if (inet_pton(AF_INET, key->str, key->v.ip) == 1)
+		key->type = SHOW_KEY_IP4;
+	else if (strchr(key->str, ':') &&
+		(inet_pton(AF_INET6, key->str, key->v.ip) == 1))
+		key->type = SHOW_KEY_IP6;
+	else
+		key->type = SHOW_KEY_STR;
+}
+
+
+static int show_key_compare(const show_key_t *f, const show_key_t *s)
+{
+	// Different types are possible within unions only
+	if (f->type != s->type)
+		return (f->type < s->type) ? -1 : 1;
+
+	switch (f->type) {
+	case SHOW_KEY_INT:
+		return (f->v.i < s->v.i) ? -1 : (f->v.i > s->v.i);
+	case SHOW_KEY_UINT:
+		return (f->v.u < s->v.u) ? -1 : (f->v.u > s->v.u);
+	case SHOW_KEY_IP4:
+		return memcmp(f->v.ip, s->v.ip, 4);
+	case SHOW_KEY_IP6:
+		return memcmp(f->v.ip, s->v.ip, 16);
+	default:
+		break;
+	}
+
+	return faux_str_numcmp(f->str, s->str);
+}
+
+
+static int show_entry_compare(const void *first, const void *second)
+{
+	const show_entry_t *f = (const show_entry_t *)first;
+	const show_entry_t *s = (const show_entry_t *)second;
+	size_t i = 0;
+
+	for (i = 0; (i < f->keys_num) && (i < s->keys_num); i++) {
+		int rc = show_key_compare(&f->keys[i], &s->keys[i]);
+		if (rc != 0)
+			return rc;
+	}
+	if (f->keys_num != s->keys_num)
+		return (f->keys_num < s->keys_num) ? -1 : 1;
+
+	return (f->pos < s->pos) ? -1 : (f->pos > s->pos);
+}
 
-	iter = faux_list_head(list);
-	while ((lyd = (const struct lyd_node *)faux_list_each(&iter)))
-		show_node(lyd, level, op, opts, parent_is_oneliner);
+
+// Fetch full list entries by slices of limited size and show them. Only one
+// slice is materialized at once.
+static void show_entries_chunked(const show_entry_t *entries,
+	size_t entries_num, size_t level, enum diff_op op, pline_opts_t *opts,
+	bool_t parent_is_oneliner, srp_sink_t *sink)
+{
+	pline_opts_t eopts = *opts;
+	size_t chunk = opts->show_chunk;
+	size_t start = 0;
+	char **paths = NULL;
+
+	// Entries within slice are complete so don't refetch its children.
+	// Nested nodes are not rendered in parallel within chunked show.
+	eopts.show_sess = NULL;
+	eopts.show_threads = 1;
+	paths = faux_zmalloc(chunk * sizeof(*paths));
+	assert(paths);
+
+	// Stop fetching when output is broken or cancelled
+	for (start = 0; (start < entries_num) && !srp_sink_error(sink);
+		start += chunk) {
+		size_t num = entries_num - start;
+		char *xpath = NULL;
+		sr_data_t *data = NULL;
+		size_t i = 0;
+
+		if (num > chunk)
+			num = chunk;
+		for (i = 0; i < num; i++) {
+			paths[i] = lyd_path(entries[start + i].node,
+				LYD_PATH_STD, NULL, 0);
+			if (!paths[i])
+				continue;
+			if (xpath)
+				faux_str_cat(&xpath, " | ");
+			faux_str_cat(&xpath, paths[i]);
+		}
+		if (xpath && (sr_get_data(opts->show_sess, xpath, 0, 0, 0,
+			&data) == SR_ERR_OK) && data) {
+			for (i = 0; i < num; i++) {
+				struct lyd_node *match = NULL;
+				if (!paths[i])
+					continue;
+				if (lyd_find_path(data->tree, paths[i], 0,
+					&match) != LY_SUCCESS)
+					continue;
+				show_node(match, level, op, &eopts,
+					parent_is_oneliner, sink);
+			}
+			sr_release_data(data);
+		}
+		for (i = 0; i < num; i++) {
+			free(paths[i]);
+			paths[i] = NULL;
+		}
+		faux_str_free(xpath);
+		// Stream rendered slice as soon as it's ready
+		srp_sink_flush(sink);
+	}
+
+	faux_free(paths);
 }
 
 
-static char *list_keys_str(const struct lyd_node *node)
+// Collect sequence of list or leaf-list entries starting with 'first' into
+// array. Entries of ordered-by system lists are sorted. The sort keys are
+// computed once for each entry. The 'keys' must be freed together with
+// entries array.
+static show_entry_t *show_list_entries(const struct lyd_node *first,
+	size_t *entries_num, show_key_t **keys, const struct lyd_node **last)
 {
-	char *keys = NULL;
+	const struct lysc_node *schema = first->schema;
 	const struct lyd_node *iter = NULL;
+	show_entry_t *entries = NULL;
+	size_t num = 0;
+	size_t keys_per_entry = 1;
+	size_t i = 0;
+	bool_t sort = (schema->flags & LYS_ORDBY_SYSTEM) ? BOOL_TRUE : BOOL_FALSE;
+
+	*keys = NULL;
+	*last = first;
+
+	// Count entries
+	for (iter = first; iter && (iter->schema == schema); iter = iter->next) {
+		*last = iter;
+		num++;
+	}
+	if (LYS_LIST == schema->nodetype) {
+		const struct lysc_node *key = NULL;
+		keys_per_entry = 0;
+		LY_LIST_FOR(lysc_node_child(schema), key) {
+			if ((key->nodetype & LYS_LEAF) && (key->flags & LYS_KEY))
+				keys_per_entry++;
+		}
+	}
 
-	if (!node)
-		return NULL;
-	if (node->schema->nodetype != LYS_LIST)
-		return NULL;
+	entries = faux_zmalloc(num * sizeof(*entries));
+	assert(entries);
+	if (sort && (keys_per_entry > 0)) {
+		*keys = faux_zmalloc(num * keys_per_entry * sizeof(**keys));
+		assert(*keys);
+	}
 
-	LY_LIST_FOR(lyd_child(node), iter) {
-		if (!(iter->schema->nodetype & LYS_LEAF))
-			continue;
-		if (!(iter->schema->flags & LYS_KEY))
+	for (i = 0, iter = first; i < num; i++, iter = iter->next) {
+		show_entry_t *entry = &entries[i];
+
+		entry->node = iter;
+		entry->pos = i;
+		if (!sort)
 			continue;
-		if (keys)
-			faux_str_cat(&keys, " ");
-		faux_str_cat(&keys, lyd_get_value(iter));
+		// Precompute sort keys
+		entry->keys = *keys + (i * keys_per_entry);
+		if (LYS_LIST == schema->nodetype) {
+			const struct lyd_node *key = NULL;
+			LY_LIST_FOR(lyd_child(iter), key) {
+				if (entry->keys_num >= keys_per_entry)
+					break;
+				if (!(key->schema->nodetype & LYS_LEAF))
+					continue;
+				if (!(key->schema->flags & LYS_KEY))
+					continue;
+				show_key_init(&entry->keys[entry->keys_num], key);
+				entry->keys_num++;
+			}
+		} else { // LEAFLIST
+			show_key_init(entry->keys, iter);
+			entry->keys_num = 1;
+		}
 	}
 
-	return keys;
+	if (sort)
+		qsort(entries, num, sizeof(*entries), show_entry_compare);
+	*entries_num = num;
+
+	return entries;
 }
 
 
-static int list_compare(const void *first, const void *second)
+static void show_entries(const show_entry_t *entries, size_t entries_num,
+	size_t level, enum diff_op op, pline_opts_t *opts,
+	bool_t parent_is_oneliner, srp_sink_t *sink)
 {
-	int rc = 0;
-	const struct lyd_node *f = (const struct lyd_node *)first;
-	const struct lyd_node *s = (const struct lyd_node *)second;
-	char *f_keys = list_keys_str(f);
-	char *s_keys = list_keys_str(s);
+	size_t i = 0;
+	pline_opts_t eopts = *opts;
+
+	if (opts->show_sess && entries_num &&
+		(LYS_LIST == entries[0].node->schema->nodetype)) {
+		// Large lists of skeleton have keys only
+		if (entries_num > opts->show_chunk) {
+			show_entries_chunked(entries, entries_num, level, op,
+				opts, parent_is_oneliner, sink);
+			return;
+		}
+		// Small lists are fetched together with skeleton
+		eopts.show_sess = NULL;
+		eopts.show_threads = 1;
+	}
+
+	for (i = 0; (i < entries_num) && !srp_sink_error(sink); i++)
+		show_node(entries[i].node, level, op, &eopts,
+			parent_is_oneliner, sink);
+}
 
-	rc = faux_str_numcmp(f_keys, s_keys);
-	faux_str_free(f_keys);
-	faux_str_free(s_keys);
 
-	return rc;
+// Show sequence of list or leaf-list entries. Returns the last node of
+// sequence.
+static const struct lyd_node *show_list_run(const struct lyd_node *first,
+	size_t level, enum diff_op op, pline_opts_t *opts,
+	bool_t parent_is_oneliner, srp_sink_t *sink)
+{
+	const struct lyd_node *last = NULL;
+	show_entry_t *entries = NULL;
+	show_key_t *keys = NULL;
+	size_t entries_num = 0;
+
+	entries = show_list_entries(first, &entries_num, &keys, &last);
+	show_entries(entries, entries_num, level, op, opts,
+		parent_is_oneliner, sink);
+	faux_free(keys);
+	faux_free(entries);
+
+	return last;
 }
 
 
-static int leaflist_compare(const void *first, const void *second)
+static bool_t show_is_run(const struct lyd_node *node, pline_opts_t *opts)
 {
-	const struct lyd_node *f = (const struct lyd_node *)first;
-	const struct lyd_node *s = (const struct lyd_node *)second;
+	if (!(node->schema->nodetype & (LYS_LIST | LYS_LEAFLIST)))
+		return BOOL_FALSE;
+	if (node->schema->flags & LYS_ORDBY_SYSTEM)
+		return BOOL_TRUE;
+	// List entries are fetched by slices within chunked show
+	if (opts->show_sess && (LYS_LIST == node->schema->nodetype))
+		return BOOL_TRUE;
 
-	return faux_str_numcmp(lyd_get_value(f), lyd_get_value(s));
+	return BOOL_FALSE;
 }
 
 
-void show_subtree(const struct lyd_node *nodes_list, size_t level,
-	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner)
+// Parallel rendering. The sibling nodes are split to independent tasks:
+// single nodes and slices of list entries. The tasks are rendered by
+// worker threads into memory sinks. The main thread writes results in
+// original order as soon as they are ready. Workers don't run far ahead of
+// writer so the rendered output kept in memory is bounded. The broken or
+// cancelled output stops workers.
+#define SHOW_TASK_ENTRIES 512
+#define SHOW_CANCEL_POLL_MS 100
+
+typedef struct {
+	const struct lyd_node *node; // Single node
+	const show_entry_t *entries; // or slice of list entries
+	size_t entries_num;
+	srp_sink_t *sink;
+	bool_t done;
+} show_task_t;
+
+
+typedef struct {
+	show_task_t *tasks;
+	size_t tasks_num;
+	size_t next; // Next task to render
+	size_t written; // Number of tasks written by main thread
+	size_t ahead; // Max number of rendered but not written tasks
+	volatile sig_atomic_t stop; // Output is broken or cancelled
+	size_t level;
+	enum diff_op op;
+	pline_opts_t *opts;
+	bool_t parent_is_oneliner;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} show_pool_t;
+
+
+static void show_task_render(show_pool_t *pool, show_task_t *task,
+	srp_sink_t *sink)
 {
-	const struct lyd_node *iter = NULL;
-	faux_list_t *list = NULL;
-	const struct lysc_node *saved_lysc = NULL;
+	if (task->node)
+		show_node(task->node, pool->level, pool->op, pool->opts,
+			pool->parent_is_oneliner, sink);
+	else
+		show_entries(task->entries, task->entries_num,
+			pool->level, pool->op, pool->opts,
+			pool->parent_is_oneliner, sink);
+}
 
-	if(!nodes_list)
-		return;
 
-	LY_LIST_FOR(nodes_list, iter) {
+static void *show_worker(void *arg)
+{
+	show_pool_t *pool = (show_pool_t *)arg;
+
+	while (1) {
+		show_task_t *task = NULL;
+
+		pthread_mutex_lock(&pool->mutex);
+		while (!pool->stop && (pool->next < pool->tasks_num) &&
+			(pool->next >= (pool->written + pool->ahead)))
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		if (!pool->stop && (pool->next < pool->tasks_num))
+			task = &pool->tasks[pool->next++];
+		pthread_mutex_unlock(&pool->mutex);
+		if (!task)
+			break;
+
+		// Task sink is cancelled by pool's stop flag
+		show_task_render(pool, task, task->sink);
+
+		pthread_mutex_lock(&pool->mutex);
+		task->done = BOOL_TRUE;
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->mutex);
+	}
 
-		if (saved_lysc) {
-			if (saved_lysc == iter->schema) {
-				faux_list_add(list, (void *)iter);
-				continue;
-			}
-			show_sorted_list(list, level, op, opts, parent_is_oneliner);
-			faux_list_free(list);
-			list = NULL;
-			saved_lysc = NULL;
-		}
-
-		if (((LYS_LIST == iter->schema->nodetype) ||
-			(LYS_LEAFLIST == iter->schema->nodetype)) &&
-			(iter->schema->flags & LYS_ORDBY_SYSTEM)) {
-			saved_lysc = iter->schema;
-			if (LYS_LIST == iter->schema->nodetype) {
-				list = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-					list_compare, NULL, NULL);
-			} else { // LEAFLIST
-				list = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-					leaflist_compare, NULL, NULL);
+	return NULL;
+}
+
+
+static void show_subtree_parallel(const struct lyd_node *nodes_list,
+	size_t level, enum diff_op op, pline_opts_t *opts,
+	bool_t parent_is_oneliner, srp_sink_t *sink)
+{
+	const struct lyd_node *iter = NULL;
+	faux_list_t *arrays = NULL; // Allocated entries and keys
+	show_pool_t pool = {};
+	pline_opts_t wopts = *opts;
+	pthread_t *threads = NULL;
+	size_t threads_num = 0;
+	size_t tasks_size = 0;
+	size_t i = 0;
+
+	// Workers don't start nested pools
+	wopts.show_threads = 1;
+	pool.level = level;
+	pool.op = op;
+	pool.opts = &wopts;
+	pool.parent_is_oneliner = parent_is_oneliner;
+	arrays = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
+
+	// Split to tasks
+	LY_LIST_FOR(nodes_list, iter) {
+		show_entry_t *entries = NULL;
+		show_key_t *keys = NULL;
+		size_t entries_num = 0;
+		size_t start = 0;
+
+		if (!show_is_run(iter, opts)) {
+			if (pool.tasks_num == tasks_size) {
+				tasks_size = tasks_size ? (tasks_size * 2) : 64;
+				pool.tasks = realloc(pool.tasks,
+					tasks_size * sizeof(*pool.tasks));
+				assert(pool.tasks);
 			}
-			faux_list_add(list, (void *)iter);
+			memset(&pool.tasks[pool.tasks_num], 0,
+				sizeof(*pool.tasks));
+			pool.tasks[pool.tasks_num++].node = iter;
 			continue;
 		}
 
-		show_node(iter, level, op, opts, parent_is_oneliner);
+		entries = show_list_entries(iter, &entries_num, &keys, &iter);
+		faux_list_add(arrays, entries);
+		if (keys)
+			faux_list_add(arrays, keys);
+		for (start = 0; start < entries_num; start += SHOW_TASK_ENTRIES) {
+			show_task_t *task = NULL;
+			if (pool.tasks_num == tasks_size) {
+				tasks_size = tasks_size ? (tasks_size * 2) : 64;
+				pool.tasks = realloc(pool.tasks,
+					tasks_size * sizeof(*pool.tasks));
+				assert(pool.tasks);
+			}
+			task = &pool.tasks[pool.tasks_num++];
+			memset(task, 0, sizeof(*task));
+			task->entries = entries + start;
+			task->entries_num = entries_num - start;
+			if (task->entries_num > SHOW_TASK_ENTRIES)
+				task->entries_num = SHOW_TASK_ENTRIES;
+		}
+	}
+	pool.stop = 0;
+	pool.ahead = opts->show_threads * 2;
+	for (i = 0; i < pool.tasks_num; i++) {
+		pool.tasks[i].sink = srp_sink_new_mem();
+		srp_sink_set_cancel(pool.tasks[i].sink, &pool.stop);
+	}
+
+	// Start workers
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+	threads = faux_zmalloc(opts->show_threads * sizeof(*threads));
+	assert(threads);
+	for (i = 0; (i < opts->show_threads) && (i < pool.tasks_num); i++) {
+		if (pthread_create(&threads[threads_num], NULL,
+			show_worker, &pool) != 0)
+			break;
+		threads_num++;
+	}
+
+	// Can't create threads. Render by itself
+	if (0 == threads_num) {
+		for (i = 0; (i < pool.tasks_num) && !srp_sink_error(sink); i++)
+			show_task_render(&pool, &pool.tasks[i], sink);
 	}
 
-	if (list) {
-		show_sorted_list(list, level, op, opts, parent_is_oneliner);
-		faux_list_free(list);
+	// Write results in original order
+	for (i = 0; (i < pool.tasks_num) && (threads_num > 0); i++) {
+		show_task_t *task = &pool.tasks[i];
+		const char *data = NULL;
+		size_t len = 0;
+		bool_t stop = BOOL_FALSE;
+
+		pthread_mutex_lock(&pool.mutex);
+		while (!task->done && !pool.stop) {
+			struct timespec ts = {};
+
+			// Poll cancel flag of sink. It's set by signal handler
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += SHOW_CANCEL_POLL_MS * 1000000L;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&pool.cond, &pool.mutex, &ts);
+			if (srp_sink_error(sink)) {
+				pool.stop = 1;
+				pthread_cond_broadcast(&pool.cond);
+			}
+		}
+		stop = pool.stop ? BOOL_TRUE : BOOL_FALSE;
+		pthread_mutex_unlock(&pool.mutex);
+		if (stop)
+			break;
+
+		data = srp_sink_data(task->sink, &len);
+		srp_sink_write(sink, data, len);
+		srp_sink_free(task->sink);
+		task->sink = NULL;
+
+		pthread_mutex_lock(&pool.mutex);
+		pool.written = i + 1;
+		if (srp_sink_error(sink))
+			pool.stop = 1;
+		pthread_cond_broadcast(&pool.cond);
+		pthread_mutex_unlock(&pool.mutex);
 	}
+
+	for (i = 0; i < threads_num; i++)
+		pthread_join(threads[i], NULL);
+	faux_free(threads);
+	for (i = 0; i < pool.tasks_num; i++)
+		srp_sink_free(pool.tasks[i].sink);
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.mutex);
+	free(pool.tasks);
+	faux_list_free(arrays);
 }
 
 
-bool_t show_xpath(sr_session_ctx_t *sess, const char *xpath,
-	size_t xpath_depth, pline_opts_t *opts)
+// Flat output. Each leaf and leaf-list value is shown by separate
+// 'set <kpath> <value>' line. The nodes without children (presence
+// containers, list entries with keys only) are shown too. The deleted
+// subtree of diff is shown by single 'del <kpath>' line. The new position of
+// user-ordered entry of diff is shown by 'insert <kpath> <position>' line.
+// The hidden password is shown by commented line so it's not applied when
+// output is loaded back. KPath of current node is collected within memory
+// sink 'path'.
+static void show_set_line(const char *cmd, srp_sink_t *path, srp_sink_t *sink)
 {
-	sr_data_t *data = NULL;
-	struct lyd_node *nodes_list = NULL;
-	const char *expath = xpath; // Effective XPath
-	size_t edepth = xpath_depth;
+	const char *data = NULL;
+	size_t len = 0;
 
-	assert(sess);
+	data = srp_sink_data(path, &len);
+	srp_sink_puts(sink, cmd);
+	srp_sink_write(sink, data, len);
+	srp_sink_puts(sink, "\n");
+}
 
-	if (!expath) {
-		expath = "/*";
-		edepth = 0;
+
+// Add KPath segment of node to path
+static void show_set_segment(const struct lyd_node *node, pline_opts_t *opts,
+	srp_sink_t *path)
+{
+	srp_sink_printf(path, " %s", node->schema->name);
+	if (node->schema->nodetype & LYS_LIST)
+		show_list_keys(node, opts, path);
+}
+
+
+// KPath of node's ancestors and node itself
+static void show_set_path(const struct lyd_node *node, pline_opts_t *opts,
+	srp_sink_t *path)
+{
+	if (!node)
+		return;
+	show_set_path(lyd_parent(node), opts, path);
+	show_set_segment(node, opts, path);
+}
+
+
+// Key values of preceding entry for 'insert' line. The diff's 'yang:key' is
+// predicate like "[name='eth0'][unit='1']". The values are quoted by single
+// or double quotes without escaping.
+static void show_set_pred_keys(const struct lysc_node *schema,
+	const char *pred, pline_opts_t *opts, srp_sink_t *sink)
+{
+	const struct lysc_node *key = lysc_node_child(schema);
+	const char *p = pred;
+	bool_t first_key = BOOL_TRUE;
+
+	while ((p = strchr(p, '='))) {
+		const char *end = NULL;
+		char *value = NULL;
+		char quote = p[1];
+
+		if ((quote != '\'') && (quote != '"'))
+			break;
+		end = strchr(p + 2, quote);
+		if (!end)
+			break;
+		value = faux_str_dupn(p + 2, end - p - 2);
+		// Identity is shown without module prefix
+		if (key && (key->nodetype & LYS_LEAF) &&
+			(((struct lysc_node_leaf *)key)->type->basetype ==
+			LY_TYPE_IDENT) && strchr(value, ':')) {
+			char *name = faux_str_dup(strchr(value, ':') + 1);
+			faux_str_free(value);
+			value = name;
+		}
+		if (key && opts->keys_w_stmt && (!first_key ||
+			opts->first_key_w_stmt || (opts->default_keys &&
+			klysc_node_ext_default(key))))
+			srp_sink_printf(sink, " %s", key->name);
+		if (kly_str_need_esc(value)) {
+			char *escaped = faux_str_c_esc_quote(value);
+			srp_sink_printf(sink, " %s", escaped);
+			faux_str_free(escaped);
+		} else {
+			srp_sink_printf(sink, " %s", value);
+		}
+		faux_str_free(value);
+		first_key = BOOL_FALSE;
+		if (key)
+			key = key->next;
+		p = end + 1;
 	}
+}
 
-	if (sr_get_data(sess, expath, 0, 0, 0, &data) != SR_ERR_OK)
-		return BOOL_FALSE;
-	if (!data) // Not found
-		return BOOL_TRUE;
-	nodes_list = data->tree;
 
-	while (nodes_list && (edepth > 0)) {
-		nodes_list = lyd_child_no_keys(nodes_list);
-		edepth--;
+// New position of user-ordered entry within diff. The 'yang:key' or
+// 'yang:value' is a preceding entry. The empty one means the first position.
+static void show_set_order(const struct lyd_node *node, pline_opts_t *opts,
+	srp_sink_t *path, srp_sink_t *sink)
+{
+	struct lyd_meta *meta = NULL;
+	const char *value = NULL;
+	const char *data = NULL;
+	size_t len = 0;
+	bool_t is_list = BOOL_FALSE;
+
+	if (!(node->schema->flags & LYS_ORDBYUSER))
+		return;
+	is_list = (node->schema->nodetype & LYS_LIST) ? BOOL_TRUE : BOOL_FALSE;
+	meta = lyd_find_meta(node->meta, NULL,
+		is_list ? "yang:key" : "yang:value");
+	if (!meta)
+		return;
+	value = lyd_get_meta_value(meta);
+
+	data = srp_sink_data(path, &len);
+	srp_sink_puts(sink, "insert");
+	srp_sink_write(sink, data, len);
+	if (faux_str_is_empty(value)) {
+		srp_sink_puts(sink, " first\n");
+		return;
+	}
+	srp_sink_puts(sink, " after");
+	if (is_list) {
+		show_set_pred_keys(node->schema, value, opts, sink);
+	} else if (kly_str_need_esc(value)) {
+		char *escaped = faux_str_c_esc_quote(value);
+		srp_sink_printf(sink, " %s", escaped);
+		faux_str_free(escaped);
+	} else {
+		srp_sink_printf(sink, " %s", value);
 	}
+	srp_sink_puts(sink, "\n");
+}
+
+
+static void show_set_nodes(const struct lyd_node *nodes_list,
+	enum diff_op op, pline_opts_t *opts, srp_sink_t *path, srp_sink_t *sink);
 
-	if (nodes_list)
-		show_subtree(nodes_list, 0, DIFF_OP_NONE, opts, BOOL_FALSE);
+
+static void show_set_node(const struct lyd_node *node, enum diff_op op,
+	pline_opts_t *opts, srp_sink_t *path, srp_sink_t *sink)
+{
+	const struct lysc_node *schema = NULL;
+	struct lyd_meta *meta = NULL;
+	enum diff_op cur_op = op;
+	size_t path_len = 0;
+	const struct lyd_node *first_child = NULL;
+	size_t child_num = 0;
+
+	if (!klyd_node_is_visible(node))
+		return;
+	schema = node->schema;
+
+	meta = lyd_find_meta(node->meta, NULL, "yang:operation");
+	if (meta)
+		cur_op = str2diff_op(lyd_get_meta_value(meta));
+
+	srp_sink_data(path, &path_len);
+	show_set_segment(node, opts, path);
+
+	// Deleted subtree. Leaf is deleted without value
+	if (DIFF_OP_DELETE == cur_op) {
+		if (DIFF_OP_DELETE != op) {
+			if (schema->nodetype & LYS_LEAFLIST) {
+				char *escaped = NULL;
+				srp_sink_puts(path, " ");
+				srp_sink_puts(path,
+					klyd_node_value_ref(node, &escaped));
+				faux_str_free(escaped);
+			}
+			show_set_line("del", path, sink);
+		}
+		srp_sink_truncate(path, path_len);
+		return;
+	}
+
+	if (schema->nodetype & (LYS_CONTAINER | LYS_LIST)) {
+		first_child = klyd_visible_child_first(node, &child_num);
+		if (0 == child_num)
+			show_set_line("set", path, sink);
+		else
+			show_set_nodes(first_child, cur_op, opts, path, sink);
+		if (schema->nodetype & LYS_LIST)
+			show_set_order(node, opts, path, sink);
+
+	} else if (schema->nodetype & LYS_LEAF) {
+		struct lysc_node_leaf *leaf = (struct lysc_node_leaf *)schema;
+		if (leaf->type->basetype != LY_TYPE_EMPTY) {
+			// Commented line is not applied by mass operations
+			if (opts->hide_passwords &&
+				klysc_node_ext_is_password(schema)) {
+				srp_sink_puts(path, " <hidden>");
+				show_set_line("# set", path, sink);
+				srp_sink_truncate(path, path_len);
+				return;
+			} else {
+				char *escaped = NULL;
+				srp_sink_puts(path, " ");
+				srp_sink_puts(path,
+					klyd_node_value_ref(node, &escaped));
+				faux_str_free(escaped);
+			}
+		}
+		show_set_line("set", path, sink);
+
+	} else if (schema->nodetype & LYS_LEAFLIST) {
+		char *escaped = NULL;
+		srp_sink_puts(path, " ");
+		srp_sink_puts(path, klyd_node_value_ref(node, &escaped));
+		faux_str_free(escaped);
+		show_set_line("set", path, sink);
+		show_set_order(node, opts, path, sink);
+	}
+
+	srp_sink_truncate(path, path_len);
+}
+
+
+static void show_set_nodes(const struct lyd_node *nodes_list,
+	enum diff_op op, pline_opts_t *opts, srp_sink_t *path, srp_sink_t *sink)
+{
+	const struct lyd_node *iter = NULL;
+
+	LY_LIST_FOR(nodes_list, iter) {
+		if (srp_sink_error(sink))
+			break;
+		show_set_node(iter, op, opts, path, sink);
+	}
+}
+
+
+static void show_set_subtree(const struct lyd_node *nodes_list,
+	enum diff_op op, pline_opts_t *opts, srp_sink_t *sink)
+{
+	srp_sink_t *path = NULL;
+
+	// Lines contain full KPath from the root
+	path = srp_sink_new_mem();
+	show_set_path(lyd_parent(nodes_list), opts, path);
+	show_set_nodes(nodes_list, op, opts, path, sink);
+	srp_sink_free(path);
+}
+
+
+// Machine-readable output. Libyang prints data straight to the sink
+static ssize_t show_ly_write(void *user_data, const void *buf, size_t count)
+{
+	if (!srp_sink_write((srp_sink_t *)user_data, (const char *)buf, count))
+		return -1;
+
+	return count;
+}
+
+
+static void show_ly_subtree(const struct lyd_node *nodes_list,
+	pline_opts_t *opts, srp_sink_t *sink)
+{
+	const struct lyd_node *root = nodes_list;
+	struct ly_out *out = NULL;
+	LYD_FORMAT format = LYD_XML;
+
+	if (SHOW_DISPLAY_JSON == opts->show_display)
+		format = LYD_JSON;
+	else if (SHOW_DISPLAY_LYB == opts->show_display)
+		format = LYD_LYB;
+
+	// Document contains ancestors of shown nodes. The sysrepo returns
+	// requested subtree with ancestors only so all top level siblings
+	// are printed. Default nodes are not shown like the text output does.
+	while (lyd_parent(root))
+		root = lyd_parent(root);
+	if (ly_out_new_clb(show_ly_write, sink, &out) != LY_SUCCESS)
+		return;
+	lyd_print_all(out, root, format, LYD_PRINT_WD_EXPLICIT);
+	ly_out_free(out, NULL, 0);
+}
+
+
+void show_subtree(const struct lyd_node *nodes_list, size_t level,
+	enum diff_op op, pline_opts_t *opts, bool_t parent_is_oneliner,
+	srp_sink_t *sink)
+{
+	const struct lyd_node *iter = NULL;
+
+	if(!nodes_list)
+		return;
+
+	if (SHOW_DISPLAY_SET == opts->show_display) {
+		show_set_subtree(nodes_list, op, opts, sink);
+		return;
+	}
+	if (SHOW_DISPLAY_TEXT != opts->show_display) {
+		show_ly_subtree(nodes_list, opts, sink);
+		return;
+	}
+
+	// Chunked show uses single sysrepo session so it can't be parallel
+	if ((opts->show_threads > 1) && !opts->show_sess &&
+		nodes_list->next) {
+		show_subtree_parallel(nodes_list, level, op, opts,
+			parent_is_oneliner, sink);
+		return;
+	}
+
+	LY_LIST_FOR(nodes_list, iter) {
+
+		// Output is broken or cancelled
+		if (srp_sink_error(sink))
+			break;
+
+		if (show_is_run(iter, opts)) {
+			iter = show_list_run(iter, level, op, opts,
+				parent_is_oneliner, sink);
+			continue;
+		}
+
+		show_node(iter, level, op, opts, parent_is_oneliner, sink);
+	}
+}
+
+
+// Numbers of operations per module and top level node. The diff is not
+// rendered.
+void show_diff_stat(const struct lyd_node *diff, pline_opts_t *opts,
+	srp_sink_t *sink)
+{
+	srp_diff_stat_t *stat = NULL;
+	srp_diff_stat_t total = {};
+	size_t stat_num = 0;
+	size_t i = 0;
+
+	stat_num = srp_diff_stat(diff, &stat);
+	for (i = 0; i < stat_num; i++) {
+		srp_diff_stat_t *cur = &stat[i];
+		if (cur->name) {
+			srp_sink_printf(sink, "%*s%s:", (int)opts->indent, "",
+				cur->name);
+		} else {
+			srp_sink_printf(sink, "%s:", cur->module);
+			total.created += cur->created;
+			total.deleted += cur->deleted;
+			total.replaced += cur->replaced;
+		}
+		srp_sink_printf(sink, " created %zu, deleted %zu, replaced %zu\n",
+			cur->created, cur->deleted, cur->replaced);
+	}
+	srp_sink_printf(sink, "Total: created %zu, deleted %zu, replaced %zu\n",
+		total.created, total.deleted, total.replaced);
+	faux_free(stat);
+}
+
+
+// Tree filters. They are applied to fetched data before rendering. The
+// nodes that can't match are pruned so they are never rendered.
+typedef struct {
+	regex_t match;
+	bool_t has_match;
+	regex_t except;
+	bool_t has_except;
+} show_filter_t;
+
+
+typedef enum {
+	SHOW_FILTER_DROP, // Node must be pruned
+	SHOW_FILTER_KEEP, // Node is not visible. Keep it as is
+	SHOW_FILTER_MATCH, // Node or its descendant matches
+} show_filter_e;
+
+
+// Node name, value or list keys match regular expression
+static bool_t show_filter_regex(const struct lyd_node *node,
+	const regex_t *re)
+{
+	const struct lyd_node *iter = NULL;
+
+	if (regexec(re, node->schema->name, 0, NULL, 0) == 0)
+		return BOOL_TRUE;
+
+	if (node->schema->nodetype & LYD_NODE_TERM) {
+		const char *value = lyd_get_value(node);
+		return (value && (regexec(re, value, 0, NULL, 0) == 0));
+	}
+
+	if (!(node->schema->nodetype & LYS_LIST))
+		return BOOL_FALSE;
+	LY_LIST_FOR(lyd_child(node), iter) {
+		const char *value = NULL;
+		if (!(iter->schema->flags & LYS_KEY))
+			break;
+		value = lyd_get_value(iter);
+		if (value && (regexec(re, value, 0, NULL, 0) == 0))
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+static struct lyd_node *show_filter_siblings(struct lyd_node *first,
+	show_filter_t *filter, bool_t matched, bool_t *found);
+
+
+static show_filter_e show_filter_node(struct lyd_node *node,
+	show_filter_t *filter, bool_t matched)
+{
+	bool_t found = BOOL_FALSE;
+
+	if (!klyd_node_is_visible(node))
+		return SHOW_FILTER_KEEP;
+
+	if (filter->has_except && show_filter_regex(node, &filter->except))
+		return SHOW_FILTER_DROP;
+
+	// Node matches. Whole subtree is shown but 'except' is still applied
+	if (!matched &&
+		(!filter->has_match || show_filter_regex(node, &filter->match)))
+		matched = BOOL_TRUE;
+	if (matched) {
+		if (filter->has_except)
+			show_filter_siblings(lyd_child(node), filter,
+				BOOL_TRUE, &found);
+		return SHOW_FILTER_MATCH;
+	}
+
+	// Node is shown as a context of matched descendants only
+	show_filter_siblings(lyd_child(node), filter, BOOL_FALSE, &found);
+
+	return found ? SHOW_FILTER_MATCH : SHOW_FILTER_DROP;
+}
+
+
+// Returns new first sibling or NULL if all siblings are pruned
+static struct lyd_node *show_filter_siblings(struct lyd_node *first,
+	show_filter_t *filter, bool_t matched, bool_t *found)
+{
+	struct lyd_node *iter = NULL;
+	struct lyd_node *next = NULL;
+	struct lyd_node *new_first = NULL;
+
+	for (iter = first; iter; iter = next) {
+		show_filter_e res = SHOW_FILTER_KEEP;
+
+		next = iter->next;
+		res = show_filter_node(iter, filter, matched);
+		if (SHOW_FILTER_DROP == res) {
+			lyd_free_tree(iter);
+			continue;
+		}
+		if (SHOW_FILTER_MATCH == res)
+			*found = BOOL_TRUE;
+		if (!new_first)
+			new_first = iter;
+	}
+
+	return new_first;
+}
+
+
+// Keep last 'last' entries of each list or leaf-list including nested
+// ones. The entries are counted in the order they are shown so the
+// ordered-by system lists are sorted the same way as renderer does. Returns
+// new first sibling.
+static struct lyd_node *show_filter_last(struct lyd_node *first, uint32_t last)
+{
+	struct lyd_node *iter = first;
+	struct lyd_node *new_first = NULL;
+
+	while (iter) {
+		show_entry_t *entries = NULL;
+		show_key_t *keys = NULL;
+		const struct lyd_node *run_last = NULL;
+		struct lyd_node *kept = NULL;
+		struct lyd_node *next = NULL;
+		size_t kept_pos = 0;
+		size_t num = 0;
+		size_t i = 0;
+
+		if (!iter->schema ||
+			!(iter->schema->nodetype & (LYS_LIST | LYS_LEAFLIST))) {
+			next = iter->next;
+			show_filter_last(lyd_child_no_keys(iter), last);
+			if (!new_first)
+				new_first = iter;
+			iter = next;
+			continue;
+		}
+
+		entries = show_list_entries(iter, &num, &keys, &run_last);
+		next = run_last->next;
+		for (i = 0; i < num; i++) {
+			struct lyd_node *node = (struct lyd_node *)entries[i].node;
+
+			if ((i + last) < num) {
+				lyd_free_tree(node);
+				continue;
+			}
+			// The first kept entry in document order
+			if (!kept || (entries[i].pos < kept_pos)) {
+				kept = node;
+				kept_pos = entries[i].pos;
+			}
+			show_filter_last(lyd_child_no_keys(node), last);
+		}
+		faux_free(keys);
+		faux_free(entries);
+		if (!new_first)
+			new_first = kept;
+		iter = next;
+	}
+
+	return new_first;
+}
+
+
+// Number of shown subtrees. It's a number of the outermost matched nodes
+// or a number of visible nodes of shown level if there is no 'match'.
+// The filtered and trimmed by 'last' tree is counted so count is equal to
+// the number of subtrees the same command shows without 'count'.
+static size_t show_filter_count(const struct lyd_node *nodes_list,
+	show_filter_t *filter)
+{
+	const struct lyd_node *iter = NULL;
+	size_t count = 0;
+
+	LY_LIST_FOR(nodes_list, iter) {
+		if (!klyd_node_is_visible(iter))
+			continue;
+		if (!filter->has_match ||
+			show_filter_regex(iter, &filter->match))
+			count++;
+		else
+			count += show_filter_count(lyd_child(iter), filter);
+	}
+
+	return count;
+}
+
+
+// The expressions are checked by caller. So error means internal failure.
+static bool_t show_filter_init(show_filter_t *filter, pline_opts_t *opts)
+{
+	memset(filter, 0, sizeof(*filter));
+
+	if (opts->show_match) {
+		if (regcomp(&filter->match, opts->show_match,
+			REG_EXTENDED | REG_NOSUB) != 0)
+			return BOOL_FALSE;
+		filter->has_match = BOOL_TRUE;
+	}
+	if (opts->show_except) {
+		if (regcomp(&filter->except, opts->show_except,
+			REG_EXTENDED | REG_NOSUB) != 0) {
+			if (filter->has_match)
+				regfree(&filter->match);
+			return BOOL_FALSE;
+		}
+		filter->has_except = BOOL_TRUE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static void show_filter_fini(show_filter_t *filter)
+{
+	if (filter->has_match)
+		regfree(&filter->match);
+	if (filter->has_except)
+		regfree(&filter->except);
+}
+
+
+static bool_t show_is_filtered(const pline_opts_t *opts)
+{
+	return (opts->show_match || opts->show_except ||
+		opts->show_count || (opts->show_last != 0));
+}
+
+
+// Paging of list. The page is selected by XPath predicates so sysrepo
+// returns requested entries only. The 'skip' and 'first' are translated to
+// position() predicates. The key range is translated to the union of
+// boundary entries and entries between them in document order. The
+// ordered-by system list is shown sorted by renderer so the document order
+// is not applicable. The whole list is fetched and the page is sliced after
+// sorting.
+static bool_t show_is_paged(const pline_opts_t *opts)
+{
+	return ((opts->show_first != 0) || (opts->show_skip != 0) ||
+		opts->show_from || opts->show_to);
+}
+
+
+// Predicate to select entry by its first key
+static char *show_page_pred(const char *key, const char *value)
+{
+	if (!strchr(value, '\''))
+		return faux_str_sprintf("[%s='%s']", key, value);
+	if (!strchr(value, '"'))
+		return faux_str_sprintf("[%s=\"%s\"]", key, value);
+
+	return NULL;
+}
+
+
+static char *show_page_xpath(sr_session_ctx_t *sess, const char *xpath,
+	const pline_opts_t *opts)
+{
+	const struct ly_ctx *ctx = NULL;
+	struct ly_set *set = NULL;
+	const struct lysc_node *node = NULL;
+	const struct lysc_node *iter = NULL;
+	const char *key = ".";
+	char *name = NULL;
+	char *from = NULL;
+	char *to = NULL;
+	char *res = NULL;
+
+	ctx = sr_session_acquire_context(sess);
+	if ((lys_find_xpath(ctx, NULL, xpath, 0, &set) == LY_SUCCESS) &&
+		(set->count > 0))
+		node = set->snodes[0];
+	if (!node || !(node->nodetype & (LYS_LIST | LYS_LEAFLIST))) {
+		fprintf(stderr, "Error: Paging is applicable to lists only\n");
+		goto err;
+	}
+
+	// Key range
+	if (node->nodetype & LYS_LIST) {
+		for (iter = lysc_node_child(node); iter; iter = iter->next) {
+			if (iter->flags & LYS_KEY) {
+				key = iter->name;
+				break;
+			}
+		}
+	}
+	if ((opts->show_from && !(from = show_page_pred(key, opts->show_from))) ||
+		(opts->show_to && !(to = show_page_pred(key, opts->show_to)))) {
+		fprintf(stderr, "Error: Illegal key value\n");
+		goto err;
+	}
+	if (node->flags & LYS_ORDBY_SYSTEM) {
+		res = faux_str_dup(xpath);
+		goto err;
+	}
+	// Siblings are addressed with module prefix to be valid at top level
+	name = faux_str_sprintf("%s:%s", node->module->name, node->name);
+
+	if (from && to)
+		res = faux_str_sprintf("%s%s | %s%s/following-sibling::%s"
+			"[following-sibling::%s%s] | %s%s",
+			xpath, from, xpath, from, name, name, to, xpath, to);
+	else if (from)
+		res = faux_str_sprintf("%s%s | %s%s/following-sibling::%s",
+			xpath, from, xpath, from, name);
+	else if (to)
+		res = faux_str_sprintf("%s%s | %s%s/preceding-sibling::%s",
+			xpath, to, xpath, to, name);
+	// Skip and first are relative to key range so they are applied to
+	// fetched data in this case
+	else if (opts->show_first)
+		res = faux_str_sprintf("%s[position() > %u and position() <= %u]",
+			xpath, opts->show_skip, opts->show_skip + opts->show_first);
+	else
+		res = faux_str_sprintf("%s[position() > %u]",
+			xpath, opts->show_skip);
+
+err:
+	faux_str_free(name);
+	faux_str_free(from);
+	faux_str_free(to);
+	ly_set_free(set, NULL);
+	sr_session_release_context(sess);
+
+	return res;
+}
+
+
+// Apply 'skip' and 'first' to fetched entries of key range. Returns new
+// first sibling.
+static struct lyd_node *show_page_slice(struct lyd_node *first,
+	const pline_opts_t *opts)
+{
+	struct lyd_node *iter = first;
+	struct lyd_node *next = NULL;
+	uint32_t pos = 0;
+
+	while (iter && (pos < opts->show_skip)) {
+		next = iter->next;
+		lyd_free_tree(iter);
+		iter = next;
+		pos++;
+	}
+	first = iter;
+	if (0 == opts->show_first)
+		return first;
+	for (pos = 0; iter && (pos < opts->show_first); pos++)
+		iter = iter->next;
+	while (iter) {
+		next = iter->next;
+		lyd_free_tree(iter);
+		iter = next;
+	}
+
+	return first;
+}
+
+
+// First key value of list entry or leaf-list value
+static const char *show_page_key(const struct lyd_node *node)
+{
+	if (node->schema->nodetype & LYS_LIST)
+		node = lyd_child(node);
+	if (!node)
+		return NULL;
+
+	return lyd_get_value(node);
+}
+
+
+// Slice page of ordered-by system list in the order it's shown. Entries out
+// of page are freed. Returns new first sibling.
+static struct lyd_node *show_page_sorted(struct lyd_node *first,
+	const pline_opts_t *opts)
+{
+	show_entry_t *entries = NULL;
+	show_key_t *keys = NULL;
+	const struct lyd_node *run_last = NULL;
+	struct lyd_node *next = NULL;
+	struct lyd_node *kept = NULL;
+	size_t kept_pos = 0;
+	size_t num = 0;
+	size_t start = 0;
+	size_t end = 0;
+	size_t i = 0;
+
+	entries = show_list_entries(first, &num, &keys, &run_last);
+	next = run_last->next;
+
+	// Key range. Missing boundary entry means empty range
+	end = num;
+	if (opts->show_from) {
+		for (start = 0; start < num; start++) {
+			if (faux_str_cmp(show_page_key(entries[start].node),
+				opts->show_from) == 0)
+				break;
+		}
+	}
+	if (opts->show_to) {
+		for (i = start; i < num; i++) {
+			if (faux_str_cmp(show_page_key(entries[i].node),
+				opts->show_to) == 0)
+				break;
+		}
+		end = (i < num) ? (i + 1) : start;
+	}
+	// Skip and first are relative to key range
+	start = ((end - start) > opts->show_skip) ?
+		(start + opts->show_skip) : end;
+	if (opts->show_first && ((end - start) > opts->show_first))
+		end = start + opts->show_first;
+
+	for (i = 0; i < num; i++) {
+		struct lyd_node *node = (struct lyd_node *)entries[i].node;
+
+		if ((i < start) || (i >= end)) {
+			lyd_free_tree(node);
+			continue;
+		}
+		if (!kept || (entries[i].pos < kept_pos)) {
+			kept = node;
+			kept_pos = entries[i].pos;
+		}
+	}
+	faux_free(keys);
+	faux_free(entries);
+
+	return kept ? kept : next;
+}
+
+
+// Full page is shown. Hint user how to get the next page. The last shown
+// entry is taken in the order entries are shown.
+static void show_page_hint(const struct lyd_node *first,
+	const pline_opts_t *opts)
+{
+	show_entry_t *entries = NULL;
+	show_key_t *keys = NULL;
+	const struct lyd_node *run_last = NULL;
+	const char *key = NULL;
+	size_t num = 0;
+
+	if (0 == opts->show_first)
+		return;
+	if (!first || !first->schema ||
+		!(first->schema->nodetype & (LYS_LIST | LYS_LEAFLIST)))
+		return;
+
+	entries = show_list_entries(first, &num, &keys, &run_last);
+	if (num >= opts->show_first)
+		key = show_page_key(entries[num - 1].node);
+	if (key)
+		fprintf(stderr, "Last shown key: %s. Next page: -- from %s skip 1 first %u\n",
+			key, key, opts->show_first);
+	faux_free(keys);
+	faux_free(entries);
+}
+
+
+static bool_t show_is_conf_node(const struct lysc_node *node)
+{
+	return ((node->nodetype & SRP_NODETYPE_CONF) &&
+		(node->flags & LYS_CONFIG_W));
+}
+
+
+// The libyang printers know nothing about klish:hidden extension so hidden
+// subtrees are removed from fetched data before printing
+static void show_prune_hidden(struct lyd_node **nodes_list)
+{
+	struct lyd_node *iter = NULL;
+	struct lyd_node *next = NULL;
+
+	LY_LIST_FOR_SAFE(*nodes_list, next, iter) {
+		struct lyd_node *child = NULL;
+
+		if (!iter->schema)
+			continue;
+		if (klysc_node_ext_is_hidden(iter->schema)) {
+			if (iter == *nodes_list)
+				*nodes_list = next;
+			lyd_free_tree(iter);
+			continue;
+		}
+		child = lyd_child_no_keys(iter);
+		show_prune_hidden(&child);
+	}
+}
+
+
+// Chunked show gets skeleton of data by single request. The skeleton
+// contains all nodes outside lists and list entries with keys only. It's
+// selected by union of all schema nodes outside lists and fetched with depth
+// 1. The list XPath with depth 1 returns entries with keys.
+static void show_skeleton_xpath_add(char **xpath, const char *prefix,
+	const struct lysc_node *nodes_list)
+{
+	const struct lysc_node *iter = NULL;
+
+	LY_LIST_FOR(nodes_list, iter) {
+		char *path = NULL;
+
+		if (!show_is_conf_node(iter))
+			continue;
+		if (klysc_node_ext_is_hidden(iter))
+			continue;
+		// Choice and case are not a part of data path
+		if (iter->nodetype & (LYS_CHOICE | LYS_CASE)) {
+			show_skeleton_xpath_add(xpath, prefix,
+				lysc_node_child(iter));
+			continue;
+		}
+		path = faux_str_sprintf("%s/%s:%s",
+			prefix, iter->module->name, iter->name);
+		if (*xpath)
+			faux_str_cat(xpath, " | ");
+		faux_str_cat(xpath, path);
+		if (iter->nodetype & LYS_CONTAINER)
+			show_skeleton_xpath_add(xpath, path,
+				lysc_node_child(iter));
+		faux_str_free(path);
+	}
+}
+
+
+// XPath of skeleton of the whole tree or container selected by 'xpath'.
+// Other nodes are not shown by chunks so NULL is returned.
+static char *show_skeleton_xpath(sr_session_ctx_t *sess, const char *xpath)
+{
+	const struct ly_ctx *ctx = NULL;
+	const struct lys_module *module = NULL;
+	struct ly_set *set = NULL;
+	uint32_t i = 0;
+	char *skeleton = NULL;
+
+	ctx = sr_session_acquire_context(sess);
+	if (!xpath) {
+		while ((module = ly_ctx_get_module_iter(ctx, &i))) {
+			if (!module->implemented || !module->compiled)
+				continue;
+			show_skeleton_xpath_add(&skeleton, "",
+				module->compiled->data);
+		}
+	} else if ((lys_find_xpath(ctx, NULL, xpath, 0, &set) == LY_SUCCESS) &&
+		(set->count == 1) &&
+		(set->snodes[0]->nodetype & LYS_CONTAINER)) {
+		skeleton = faux_str_dup(xpath);
+		show_skeleton_xpath_add(&skeleton, xpath,
+			lysc_node_child(set->snodes[0]));
+	}
+	ly_set_free(set, NULL);
+	sr_session_release_context(sess);
+
+	return skeleton;
+}
+
+
+// Union of XPaths of entries of skeleton lists with not more than 'chunk'
+// entries. Each entry is selected by its own path with keys so other
+// entries of list are not fetched.
+static void show_skeleton_small_lists(const struct lyd_node *nodes_list,
+	size_t chunk, char **xpath)
+{
+	const struct lyd_node *iter = nodes_list;
+
+	while (iter) {
+		const struct lyd_node *run = iter;
+		size_t num = 0;
+
+		if (!iter->schema || !(iter->schema->nodetype & LYS_LIST)) {
+			if (iter->schema &&
+				(iter->schema->nodetype & LYS_CONTAINER))
+				show_skeleton_small_lists(lyd_child(iter),
+					chunk, xpath);
+			iter = iter->next;
+			continue;
+		}
+		// Entries of list are adjacent
+		for (; iter && (iter->schema == run->schema); iter = iter->next)
+			num++;
+		if (num > chunk)
+			continue;
+		for (; run != iter; run = run->next) {
+			char *path = lyd_path(run, LYD_PATH_STD, NULL, 0);
+			if (!path)
+				continue;
+			if (*xpath)
+				faux_str_cat(xpath, " | ");
+			faux_str_cat(xpath, path);
+			free(path);
+		}
+	}
+}
+
+
+// Lists larger than chunk are fetched by slices while rendering. Smaller
+// lists are fetched at once and merged into skeleton.
+static void show_skeleton_complete(sr_session_ctx_t *sess, sr_data_t *data,
+	size_t chunk)
+{
+	char *xpath = NULL;
+	sr_data_t *lists = NULL;
+
+	show_skeleton_small_lists(data->tree, chunk, &xpath);
+	if (!xpath)
+		return;
+	if ((sr_get_data(sess, xpath, 0, 0, 0, &lists) == SR_ERR_OK) &&
+		lists) {
+		// Source tree is spent by merge
+		lyd_merge_siblings(&data->tree, lists->tree,
+			LYD_MERGE_DESTRUCT);
+		lists->tree = NULL;
+		sr_release_data(lists);
+	}
+	faux_str_free(xpath);
+}
+
+
+// Merge-walk configuration and state trees. State subtrees are copied under
+// matching configuration nodes. The state without configuration parent has
+// nothing to annotate so it's ignored.
+static void show_state_merge(struct lyd_node *parent,
+	struct lyd_node *siblings, const struct lyd_node *state)
+{
+	const struct lyd_node *iter = NULL;
+
+	LY_LIST_FOR(state, iter) {
+		struct lyd_node *match = NULL;
+
+		if (!iter->schema)
+			continue;
+		if (!(iter->schema->flags & LYS_CONFIG_W)) {
+			if (parent)
+				lyd_dup_single(iter,
+					(struct lyd_node_inner *)parent,
+					LYD_DUP_RECURSIVE, NULL);
+			continue;
+		}
+		if (lyd_find_sibling_first(siblings, iter, &match) != LY_SUCCESS)
+			continue;
+		show_state_merge(match, lyd_child(match), lyd_child(iter));
+	}
+}
+
+
+// Get operational data for the same XPath and merge it into configuration
+// tree. So renderer shows both within single pass.
+static void show_state_fetch(sr_session_ctx_t *sess, const char *xpath,
+	uint32_t max_depth, sr_data_t *data)
+{
+	sr_datastore_t ds = sr_session_get_ds(sess);
+	sr_data_t *state = NULL;
+	int rc = SR_ERR_OK;
+
+	sr_session_switch_ds(sess, SR_DS_OPERATIONAL);
+	rc = sr_get_data(sess, xpath, max_depth, 0, SR_OPER_NO_CONFIG, &state);
+	sr_session_switch_ds(sess, ds);
+	if ((rc != SR_ERR_OK) || !state)
+		return;
+	show_state_merge(NULL, data->tree, state->tree);
+	sr_release_data(state);
+}
+
+
+bool_t show_xpath(sr_session_ctx_t *sess, const char *xpath,
+	size_t xpath_depth, pline_opts_t *opts, srp_sink_t *sink)
+{
+	sr_data_t *data = NULL;
+	struct lyd_node *nodes_list = NULL;
+	const char *expath = xpath; // Effective XPath
+	size_t edepth = xpath_depth;
+	uint32_t max_depth = 0;
+	pline_opts_t eopts = *opts; // Effective options
+	char *xpath_buf = NULL; // Allocated effective XPath
+	int rc = SR_ERR_OK;
+
+	assert(sess);
+
+	if (!expath) {
+		expath = "/*";
+		edepth = 0;
+	}
+
+	// Paged list
+	if (xpath && show_is_paged(opts)) {
+		xpath_buf = show_page_xpath(sess, xpath, opts);
+		if (!xpath_buf)
+			return BOOL_FALSE;
+		expath = xpath_buf;
+	}
+
+	// Limit depth of fetched data. Sysrepo counts depth from selected node.
+	// One more level is fetched to know number of children of collapsed
+	// nodes.
+	eopts.show_depth_base = edepth;
+	if (eopts.show_depth != 0)
+		max_depth = eopts.show_depth + (xpath ? 2 : 1);
+
+	// Chunked show. Get skeleton of shown subtree and small lists by two
+	// requests. Large lists are fetched by slices while rendering.
+	eopts.show_sess = NULL;
+	// Flat and machine-readable output needs the whole subtree
+	if (SHOW_DISPLAY_TEXT != eopts.show_display) {
+		eopts.show_depth = 0;
+		max_depth = 0;
+	// Filters need the whole subtree to prune it. State is merged into
+	// the whole subtree too. Paged list is bounded already.
+	} else if ((0 == eopts.show_depth) && (eopts.show_chunk != 0) &&
+		!show_is_filtered(&eopts) && !eopts.show_state &&
+		!show_is_paged(&eopts)) {
+		char *skeleton = show_skeleton_xpath(sess, xpath);
+		if (skeleton) {
+			faux_str_free(xpath_buf);
+			xpath_buf = skeleton;
+			expath = skeleton;
+			eopts.show_sess = sess;
+			// Chunked show uses single sysrepo session
+			eopts.show_threads = 1;
+			max_depth = 1;
+		}
+	}
+
+	rc = sr_get_data(sess, expath, max_depth, 0, 0, &data);
+	if ((SR_ERR_OK == rc) && data && eopts.show_state)
+		show_state_fetch(sess, expath, max_depth, data);
+	if ((SR_ERR_OK == rc) && data && eopts.show_sess)
+		show_skeleton_complete(sess, data, eopts.show_chunk);
+	faux_str_free(xpath_buf);
+	if (rc != SR_ERR_OK)
+		return BOOL_FALSE;
+	if (!data) // Not found
+		return BOOL_TRUE;
+	// Text renderers skip hidden nodes themselves
+	if ((eopts.show_display != SHOW_DISPLAY_TEXT) &&
+		(eopts.show_display != SHOW_DISPLAY_SET))
+		show_prune_hidden(&data->tree);
+	nodes_list = data->tree;
+
+	while (nodes_list && (edepth > 0)) {
+		nodes_list = lyd_child_no_keys(nodes_list);
+		edepth--;
+	}
+
+	if (nodes_list && show_is_paged(&eopts)) {
+		bool_t top = (nodes_list == data->tree);
+		if (nodes_list->schema &&
+			(nodes_list->schema->flags & LYS_ORDBY_SYSTEM))
+			nodes_list = show_page_sorted(nodes_list, &eopts);
+		else if (eopts.show_from || eopts.show_to)
+			nodes_list = show_page_slice(nodes_list, &eopts);
+		if (top)
+			data->tree = nodes_list;
+	}
+
+	if (nodes_list && show_is_filtered(&eopts)) {
+		show_filter_t filter = {};
+		bool_t found = BOOL_FALSE;
+		bool_t top = (nodes_list == data->tree);
+
+		if (!show_filter_init(&filter, &eopts)) {
+			sr_release_data(data);
+			return BOOL_FALSE;
+		}
+		nodes_list = show_filter_siblings(nodes_list, &filter,
+			BOOL_FALSE, &found);
+		if (nodes_list && (eopts.show_last != 0))
+			nodes_list = show_filter_last(nodes_list, eopts.show_last);
+		// The first top level node can be pruned
+		if (top)
+			data->tree = nodes_list;
+		// Count doesn't render anything
+		if (eopts.show_count) {
+			srp_sink_printf(sink, "Count: %zu\n",
+				show_filter_count(nodes_list, &filter));
+			nodes_list = NULL;
+		}
+		show_filter_fini(&filter);
+	}
+
+	if (nodes_list) {
+		show_subtree(nodes_list, 0, DIFF_OP_NONE, &eopts, BOOL_FALSE, sink);
+		if (SHOW_DISPLAY_TEXT == eopts.show_display)
+			show_state(nodes_list, 0, &eopts, sink);
+	}
+	if (nodes_list && show_is_paged(&eopts)) {
+		srp_sink_flush(sink);
+		show_page_hint(nodes_list, &eopts);
+	}
 	sr_release_data(data);
 
 	return BOOL_TRUE;
@@ -0,0 +1,372 @@
+/** @file sink.c
+ * @brief Buffered output sink.
+ *
+ * Renderers produce a lot of small pieces of output. The sink collects them
+ * within large buffer and writes buffer at once when it's full or on flush.
+ * The data that is larger than buffer is written together with buffered data
+ * by single writev() call. The sink writes to raw file descriptor or
+ * to klish context using kcontext_printf(). The memory sink doesn't write
+ * anything but grows the buffer. It's used to render parts of output in
+ * parallel.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <faux/faux.h>
+#include <klish/kcontext.h>
+
+#include "klish_plugin_sysrepo.h"
+
+#define SRP_SINK_BUF_SIZE (64 * 1024)
+#define SRP_SINK_MEM_SIZE (4 * 1024)
+
+
+struct srp_sink_s {
+	int fd; // Target file descriptor or -1
+	kcontext_t *context; // Target klish context or NULL
+	bool_t mem; // Memory sink
+	char *buf;
+	size_t size;
+	size_t len;
+	bool_t error; // Write error. All further output is dropped
+	volatile sig_atomic_t *cancel; // Output is cancelled when it's set
+};
+
+
+static srp_sink_t *srp_sink_new_internal(int fd, kcontext_t *context,
+	size_t size)
+{
+	srp_sink_t *sink = NULL;
+
+	sink = faux_zmalloc(sizeof(*sink));
+	assert(sink);
+	if (!sink)
+		return NULL;
+
+	// Initialize
+	sink->fd = fd;
+	sink->context = context;
+	sink->mem = ((fd < 0) && !context) ? BOOL_TRUE : BOOL_FALSE;
+	sink->size = size;
+	sink->len = 0;
+	sink->error = BOOL_FALSE;
+	sink->cancel = NULL;
+	sink->buf = faux_malloc(sink->size);
+	assert(sink->buf);
+
+	return sink;
+}
+
+
+srp_sink_t *srp_sink_new(int fd)
+{
+	// Something can be already printed by stdio. Keep order
+	if (STDOUT_FILENO == fd)
+		fflush(stdout);
+
+	return srp_sink_new_internal(fd, NULL, SRP_SINK_BUF_SIZE);
+}
+
+
+srp_sink_t *srp_sink_new_context(kcontext_t *context)
+{
+	assert(context);
+	if (!context)
+		return NULL;
+
+	return srp_sink_new_internal(-1, context, SRP_SINK_BUF_SIZE);
+}
+
+
+srp_sink_t *srp_sink_new_mem(void)
+{
+	return srp_sink_new_internal(-1, NULL, SRP_SINK_MEM_SIZE);
+}
+
+
+// Get data collected by memory sink
+const char *srp_sink_data(const srp_sink_t *sink, size_t *len)
+{
+	assert(sink);
+	if (!sink)
+		return NULL;
+
+	if (len)
+		*len = sink->len;
+
+	return sink->buf;
+}
+
+
+// Drop data collected by memory sink after 'len' bytes
+void srp_sink_truncate(srp_sink_t *sink, size_t len)
+{
+	assert(sink);
+	if (!sink)
+		return;
+
+	if (sink->mem && (len < sink->len))
+		sink->len = len;
+}
+
+
+// Grow buffer of memory sink to have at least 'need' free bytes
+static void srp_sink_grow(srp_sink_t *sink, size_t need)
+{
+	size_t size = sink->size;
+
+	while ((size - sink->len) < need)
+		size = size * 2;
+	if (size == sink->size)
+		return;
+	sink->buf = realloc(sink->buf, size);
+	assert(sink->buf);
+	sink->size = size;
+}
+
+
+void srp_sink_free(srp_sink_t *sink)
+{
+	if (!sink)
+		return;
+
+	srp_sink_flush(sink);
+	faux_free(sink->buf);
+	faux_free(sink);
+}
+
+
+// The flag is usually set by signal handler. Renderers check sink error
+// between chunks of output so they stop early.
+void srp_sink_set_cancel(srp_sink_t *sink, volatile sig_atomic_t *cancel)
+{
+	assert(sink);
+	if (!sink)
+		return;
+
+	sink->cancel = cancel;
+}
+
+
+// Cancelled sink drops all further output like the sink with error
+static bool_t srp_sink_is_broken(srp_sink_t *sink)
+{
+	if (sink->cancel && *sink->cancel)
+		sink->error = BOOL_TRUE;
+
+	return sink->error;
+}
+
+
+bool_t srp_sink_error(srp_sink_t *sink)
+{
+	assert(sink);
+	if (!sink)
+		return BOOL_TRUE;
+
+	return srp_sink_is_broken(sink);
+}
+
+
+static bool_t srp_sink_writev(srp_sink_t *sink, struct iovec *iov, int iovcnt)
+{
+	// Klish context has no vector interface
+	if (sink->context) {
+		int i = 0;
+		for (i = 0; i < iovcnt; i++) {
+			if (0 == iov[i].iov_len)
+				continue;
+			if (kcontext_printf(sink->context, "%.*s",
+				(int)iov[i].iov_len, (char *)iov[i].iov_base) < 0)
+				return BOOL_FALSE;
+		}
+		return BOOL_TRUE;
+	}
+
+	while (iovcnt > 0) {
+		ssize_t r = writev(sink->fd, iov, iovcnt);
+		size_t written = 0;
+
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return BOOL_FALSE;
+		}
+		// Partial write. Skip written data
+		written = (size_t)r;
+		while ((iovcnt > 0) && (written >= iov->iov_len)) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+bool_t srp_sink_flush(srp_sink_t *sink)
+{
+	struct iovec iov = {};
+
+	assert(sink);
+	if (!sink)
+		return BOOL_FALSE;
+	if (srp_sink_is_broken(sink))
+		return BOOL_FALSE;
+	if (0 == sink->len)
+		return BOOL_TRUE;
+	// Memory sink keeps all data
+	if (sink->mem)
+		return BOOL_TRUE;
+
+	iov.iov_base = sink->buf;
+	iov.iov_len = sink->len;
+	sink->len = 0;
+	if (!srp_sink_writev(sink, &iov, 1))
+		sink->error = BOOL_TRUE;
+
+	return !sink->error;
+}
+
+
+bool_t srp_sink_write(srp_sink_t *sink, const char *data, size_t len)
+{
+	assert(sink);
+	if (!sink)
+		return BOOL_FALSE;
+	if (srp_sink_is_broken(sink))
+		return BOOL_FALSE;
+	if (0 == len)
+		return BOOL_TRUE;
+
+	if (sink->mem)
+		srp_sink_grow(sink, len);
+
+	// Fast path. Data fits buffer
+	if (len <= (sink->size - sink->len)) {
+		memcpy(sink->buf + sink->len, data, len);
+		sink->len += len;
+		return BOOL_TRUE;
+	}
+
+	// Large data. Write it together with buffered data
+	if (len >= sink->size) {
+		struct iovec iov[2] = {};
+		iov[0].iov_base = sink->buf;
+		iov[0].iov_len = sink->len;
+		iov[1].iov_base = (void *)data;
+		iov[1].iov_len = len;
+		sink->len = 0;
+		if (!srp_sink_writev(sink, iov, 2))
+			sink->error = BOOL_TRUE;
+		return !sink->error;
+	}
+
+	if (!srp_sink_flush(sink))
+		return BOOL_FALSE;
+	memcpy(sink->buf, data, len);
+	sink->len = len;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t srp_sink_puts(srp_sink_t *sink, const char *str)
+{
+	if (!str)
+		return BOOL_TRUE;
+
+	return srp_sink_write(sink, str, strlen(str));
+}
+
+
+bool_t srp_sink_vprintf(srp_sink_t *sink, const char *fmt, va_list ap)
+{
+	va_list ap2;
+	int r = 0;
+	size_t room = 0;
+	char *tmp = NULL;
+	bool_t res = BOOL_FALSE;
+
+	assert(sink);
+	if (!sink)
+		return BOOL_FALSE;
+	if (srp_sink_is_broken(sink))
+		return BOOL_FALSE;
+
+	// Try to format right into the buffer
+	room = sink->size - sink->len;
+	va_copy(ap2, ap);
+	r = vsnprintf(sink->buf + sink->len, room, fmt, ap2);
+	va_end(ap2);
+	if (r < 0)
+		return BOOL_FALSE;
+	if ((size_t)r < room) {
+		sink->len += r;
+		return BOOL_TRUE;
+	}
+
+	// Memory sink. Grow buffer and format again
+	if (sink->mem) {
+		srp_sink_grow(sink, (size_t)r + 1);
+		va_copy(ap2, ap);
+		r = vsnprintf(sink->buf + sink->len, sink->size - sink->len,
+			fmt, ap2);
+		va_end(ap2);
+		if (r < 0)
+			return BOOL_FALSE;
+		sink->len += r;
+		return BOOL_TRUE;
+	}
+
+	// Doesn't fit the rest of buffer but fits empty buffer
+	if ((size_t)r < sink->size) {
+		if (!srp_sink_flush(sink))
+			return BOOL_FALSE;
+		va_copy(ap2, ap);
+		r = vsnprintf(sink->buf, sink->size, fmt, ap2);
+		va_end(ap2);
+		if (r < 0)
+			return BOOL_FALSE;
+		sink->len = r;
+		return BOOL_TRUE;
+	}
+
+	// Too large string
+	tmp = faux_malloc(r + 1);
+	assert(tmp);
+	va_copy(ap2, ap);
+	vsnprintf(tmp, r + 1, fmt, ap2);
+	va_end(ap2);
+	res = srp_sink_write(sink, tmp, r);
+	faux_free(tmp);
+
+	return res;
+}
+
+
+bool_t srp_sink_printf(srp_sink_t *sink, const char *fmt, ...)
+{
+	va_list ap;
+	bool_t res = BOOL_FALSE;
+
+	va_start(ap, fmt);
+	res = srp_sink_vprintf(sink, fmt, ap);
+	va_end(ap);
+
+	return res;
+}
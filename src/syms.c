@@ -1,8 +1,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <signal.h>
+#include <regex.h>
 
 #include <faux/faux.h>
 #include <faux/str.h>
@@ -10,6 +14,7 @@
 #include <faux/list.h>
 #include <faux/error.h>
 #include <faux/file.h>
+#include <faux/conv.h>
 #include <klish/khelper.h>
 #include <klish/kplugin.h>
 #include <klish/kentry.h>
@@ -29,6 +34,30 @@
 #define ARG_PATH "path"
 #define ARG_FROM_PATH "from_path"
 #define ARG_TO_PATH "to_path"
+#define ARG_DEPTH "depth_num"
+#define ARG_DISPLAY_SET "set"
+#define ARG_DISPLAY_XML "xml"
+#define ARG_DISPLAY_JSON "json"
+#define ARG_DISPLAY_LYB "lyb"
+#define ARG_MATCH "match_regex"
+#define ARG_EXCEPT "except_regex"
+#define ARG_COUNT "count"
+#define ARG_LAST "last_num"
+#define ARG_FIRST "first_num"
+#define ARG_SKIP "skip_num"
+#define ARG_FROM "from_key"
+#define ARG_TO "to_key"
+#define ARG_WITH_STATE "with-state"
+#define ARG_STAT "stat"
+#define ARG_DIFF_FROM "diff_from"
+#define ARG_DIFF_TO "diff_to"
+#define ARG_SYNCHRONIZE "synchronize"
+#define ARG_STATUS "status"
+
+// Separator between path and output options of 'show' and 'diff'. The
+// options are keywords so they can't precede the path where they are
+// indistinguishable from YANG node names.
+#define SHOW_OPTS_SEP "--"
 
 
 // Print sysrepo session errors
@@ -94,6 +123,61 @@ static faux_argv_t *param2argv(const faux_argv_t *cur_path,
 }
 
 
+// Apply pending edits of session to candidate
+static int srp_apply_changes(kcontext_t *context, sr_session_ctx_t *sess)
+{
+	srp_udata_t *udata = srp_udata(context);
+	size_t num = udata->deferred_num;
+
+	udata->deferred_num = 0;
+	if (!sr_has_changes(sess))
+		return 0;
+	if (sr_apply_changes(sess, 0) != SR_ERR_OK) {
+		sr_discard_changes(sess);
+		srp_error(sess, ERRORMSG "Can't apply changes\n");
+		if (num > 1)
+			fprintf(stderr, ERRORMSG "%zu deferred edits are discarded\n",
+				num);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+// Completion gets existing nodes from datastore. Deferred edits are not
+// visible there so they are applied if some completion is within edited
+// subtree.
+static void srp_compl_apply_deferred(kcontext_t *context,
+	sr_session_ctx_t *sess, pline_t *pline)
+{
+	const struct lyd_node *edit = NULL;
+	faux_list_node_t *iter = NULL;
+	pcompl_t *pcompl = NULL;
+
+	if (!sr_has_changes(sess))
+		return;
+	edit = sr_get_changes(sess);
+
+	iter = faux_list_head(pline->compls);
+	while ((pcompl = (pcompl_t *)faux_list_each(&iter))) {
+		struct ly_set *set = NULL;
+		bool_t found = BOOL_FALSE;
+
+		if (!pcompl->xpath || (pcompl->xpath_ds != SRP_REPO_EDIT))
+			continue;
+		if (lyd_find_xpath(edit, pcompl->xpath, &set) != LY_SUCCESS)
+			continue;
+		found = (set->count > 0) ? BOOL_TRUE : BOOL_FALSE;
+		ly_set_free(set, NULL);
+		if (found) {
+			srp_apply_changes(context, sess);
+			return;
+		}
+	}
+}
+
+
 // Candidate from pargv contains possible begin of current word (that must be
 // completed). kpargv's list don't contain candidate but only already parsed
 // words.
@@ -105,6 +189,7 @@ static int srp_compl_or_help(kcontext_t *context, bool_t help,
 	sr_session_ctx_t *sess = NULL;
 	const char *entry_name = NULL;
 	faux_argv_t *cur_path = NULL;
+	srp_sink_t *sink = NULL;
 
 	assert(context);
 
@@ -118,7 +203,11 @@ static int srp_compl_or_help(kcontext_t *context, bool_t help,
 	args = param2argv(cur_path, kcontext_parent_pargv(context), entry_name);
 	pline = pline_parse(sess, args, srp_udata_opts(context));
 	faux_argv_free(args);
-	pline_print_completions(pline, help, enabled_ptypes, existing_nodes_only);
+	srp_compl_apply_deferred(context, sess, pline);
+	sink = srp_sink_new(STDOUT_FILENO);
+	pline_print_completions(pline, help, enabled_ptypes,
+		existing_nodes_only, sink);
+	srp_sink_free(sink);
 	pline_free(pline);
 
 	return 0;
@@ -299,14 +388,28 @@ int srp_PLINE_DEL(kcontext_t *context)
 }
 
 
+// The path of 'show' and 'diff' ends on options separator
+static bool_t srp_is_opts_sep(kcontext_t *context)
+{
+	return (faux_str_cmp(kcontext_candidate_value(context),
+		SHOW_OPTS_SEP) == 0);
+}
+
+
 int srp_PLINE_EDIT(kcontext_t *context)
 {
+	if (srp_is_opts_sep(context))
+		return -1;
+
 	return srp_check_type(context, PT_NOT_EDIT, 1, BOOL_TRUE);
 }
 
 
 int srp_PLINE_EDIT_ABS(kcontext_t *context)
 {
+	if (srp_is_opts_sep(context))
+		return -1;
+
 	return srp_check_type(context, PT_NOT_EDIT, 1, BOOL_FALSE);
 }
 
@@ -319,12 +422,18 @@ int srp_PLINE_INSERT_FROM(kcontext_t *context)
 
 int srp_PLINE_SHOW(kcontext_t *context)
 {
+	if (srp_is_opts_sep(context))
+		return -1;
+
 	return srp_check_type(context, PT_NOT_SHOW, 1, BOOL_TRUE);
 }
 
 
 int srp_PLINE_SHOW_ABS(kcontext_t *context)
 {
+	if (srp_is_opts_sep(context))
+		return -1;
+
 	return srp_check_type(context, PT_NOT_SHOW, 1, BOOL_FALSE);
 }
 
@@ -404,6 +513,7 @@ static int srp_compl_or_help_insert_to(kcontext_t *context, bool_t help)
 	pline_t *pline = NULL;
 	sr_session_ctx_t *sess = NULL;
 	faux_argv_t *cur_path = NULL;
+	srp_sink_t *sink = NULL;
 
 	assert(context);
 	sess = srp_udata_sr_sess(context);
@@ -415,7 +525,10 @@ static int srp_compl_or_help_insert_to(kcontext_t *context, bool_t help)
 		cur_path, NULL, srp_udata_opts(context));
 	pline = pline_parse(sess, args, srp_udata_opts(context));
 	faux_argv_free(args);
-	pline_print_completions(pline, help, PT_COMPL_INSERT, BOOL_TRUE);
+	srp_compl_apply_deferred(context, sess, pline);
+	sink = srp_sink_new(STDOUT_FILENO);
+	pline_print_completions(pline, help, PT_COMPL_INSERT, BOOL_TRUE, sink);
+	srp_sink_free(sink);
 	pline_free(pline);
 
 	return 0;
@@ -434,6 +547,23 @@ int srp_help_insert_to(kcontext_t *context)
 }
 
 
+// Edit operation is done. In deferred mode edits are accumulated within
+// session and applied by single transaction later
+static int srp_edit_done(kcontext_t *context, sr_session_ctx_t *sess)
+{
+	srp_udata_t *udata = srp_udata(context);
+	uint32_t limit = srp_udata_opts(context)->deferred_limit;
+
+	if (udata->deferred) {
+		udata->deferred_num++;
+		if ((0 == limit) || (udata->deferred_num < limit))
+			return 0;
+	}
+
+	return srp_apply_changes(context, sess);
+}
+
+
 int srp_set(kcontext_t *context)
 {
 	int ret = 0;
@@ -443,7 +573,9 @@ int srp_set(kcontext_t *context)
 	faux_list_node_t *iter = NULL;
 	pexpr_t *expr = NULL;
 	size_t err_num = 0;
+	size_t set_num = 0;
 	faux_argv_t *cur_path = NULL;
+	struct lyd_node *deferred = NULL;
 
 	assert(context);
 	sess = srp_udata_sr_sess(context);
@@ -461,6 +593,12 @@ int srp_set(kcontext_t *context)
 		goto cleanup;
 	}
 
+	// Failed command can't discard deferred edits of previous commands.
+	// So they are saved and restored on error
+	if ((faux_list_len(pline->exprs) > 1) && sr_has_changes(sess))
+		lyd_dup_siblings(sr_get_changes(sess), NULL,
+			LYD_DUP_RECURSIVE, &deferred);
+
 	iter = faux_list_head(pline->exprs);
 	while ((expr = (pexpr_t *)faux_list_each(&iter))) {
 		if (!(expr->pat & PT_SET)) {
@@ -474,6 +612,8 @@ int srp_set(kcontext_t *context)
 			srp_error(sess, ERRORMSG "Can't set data\n");
 			break;
 		}
+		srp_journal_add(srp_udata_journal(context), expr->xpath);
+		set_num++;
 	}
 	if (err_num > 0)
 		ret = -1;
@@ -482,17 +622,20 @@ int srp_set(kcontext_t *context)
 		goto cleanup;
 
 	if (err_num > 0) {
+		// Nothing is set by failed command
+		if (0 == set_num)
+			goto cleanup;
 		sr_discard_changes(sess);
+		if (deferred)
+			sr_edit_batch(sess, deferred, "merge");
 		goto cleanup;
 	}
 
-	if (sr_apply_changes(sess, 0) != SR_ERR_OK) {
-		sr_discard_changes(sess);
-		srp_error(sess, ERRORMSG "Can't apply changes\n");
-		goto cleanup;
-	}
+	if (srp_edit_done(context, sess) < 0)
+		ret = -1;
 
 cleanup:
+	lyd_free_siblings(deferred);
 	pline_free(pline);
 
 	return ret;
@@ -539,12 +682,10 @@ int srp_del(kcontext_t *context)
 		srp_error(sess, ERRORMSG "Can't delete data\n");
 		goto err;
 	}
+	srp_journal_add(srp_udata_journal(context), expr->xpath);
 
-	if (sr_apply_changes(sess, 0) != SR_ERR_OK) {
-		sr_discard_changes(sess);
-		srp_error(sess, ERRORMSG "Can't apply changes\n");
+	if (srp_edit_done(context, sess) < 0)
 		goto err;
-	}
 
 	ret = 0;
 err:
@@ -593,12 +734,10 @@ int srp_edit(kcontext_t *context)
 		srp_error(sess, ERRORMSG "Can't set editing data\n");
 		goto err;
 	}
+	srp_journal_add(srp_udata_journal(context), expr->xpath);
 
-	if (sr_apply_changes(sess, 0) != SR_ERR_OK) {
-		sr_discard_changes(sess);
-		srp_error(sess, ERRORMSG "Can't apply changes\n");
+	if (srp_edit_done(context, sess) < 0)
 		goto err;
-	}
 
 	// Set new current path
 	srp_udata_set_path(context, args);
@@ -769,12 +908,10 @@ int srp_insert(kcontext_t *context)
 		srp_error(sess, ERRORMSG "Can't move element\n");
 		goto err;
 	}
+	srp_journal_add_order(srp_udata_journal(context), expr->xpath);
 
-	if (sr_apply_changes(sess, 0) != SR_ERR_OK) {
-		sr_discard_changes(sess);
-		srp_error(sess, ERRORMSG "Can't apply changes\n");
+	if (srp_edit_done(context, sess) < 0)
 		goto err;
-	}
 
 	ret = 0;
 err:
@@ -785,24 +922,184 @@ err:
 }
 
 
-int srp_verify(kcontext_t *context)
+// Modules changed within candidate relative to running-config. They are
+// got from diff when the journal can't be used.
+static bool_t srp_diff_modules(sr_session_ctx_t *sess, faux_argv_t *modules)
+{
+	struct lyd_node *diff = NULL;
+	const struct lyd_node *iter = NULL;
+	faux_argv_t *changed = NULL;
+
+	if (!srp_diff_get(sess, NULL, NULL, NULL, &diff))
+		return BOOL_FALSE;
+	changed = faux_argv_new();
+	LY_LIST_FOR(diff, iter) {
+		const char *name = iter->schema->module->name;
+		faux_argv_node_t *cur = faux_argv_iter(changed);
+		const char *str = NULL;
+
+		while ((str = faux_argv_each(&cur))) {
+			if (faux_str_cmp(str, name) == 0)
+				break;
+		}
+		if (!str)
+			faux_argv_add(changed, name);
+	}
+	srp_journal_affected(sess, changed, modules);
+	faux_argv_free(changed);
+	lyd_free_siblings(diff);
+
+	return BOOL_TRUE;
+}
+
+
+// Validate candidate config. The journal knows modules changed since last
+// commit or reset so only these modules and modules which depend on them
+// are validated. When the journal can't be used the changed modules are
+// got from diff of candidate and running-config. The whole config is
+// validated when diff can't be got.
+static int srp_validate(kcontext_t *context, sr_session_ctx_t *sess)
 {
 	int ret = -1;
+	faux_argv_t *modules = NULL;
+	faux_argv_node_t *iter = NULL;
+	const char *module = NULL;
+
+	modules = faux_argv_new();
+	if (!srp_journal_modules(srp_udata_journal(context), modules) &&
+		!srp_diff_modules(sess, modules)) {
+		if (sr_validate(sess, NULL, 0) != SR_ERR_OK) {
+			srp_error(sess, ERRORMSG "Invalid candidate configuration\n");
+			goto err;
+		}
+		ret = 0;
+		goto err;
+	}
+
+	iter = faux_argv_iter(modules);
+	while ((module = faux_argv_each(&iter))) {
+		if (sr_validate(sess, module, 0) != SR_ERR_OK) {
+			srp_error(sess, ERRORMSG "Invalid candidate configuration\n");
+			goto err;
+		}
+	}
+
+	ret = 0;
+err:
+	faux_argv_free(modules);
+
+	return ret;
+}
+
+
+int srp_verify(kcontext_t *context)
+{
 	sr_session_ctx_t *sess = NULL;
 
 	assert(context);
 	sess = srp_udata_sr_sess(context);
 	if (!sess)
 		return -1;
+	if (srp_apply_changes(context, sess) < 0)
+		return -1;
+
+	return srp_validate(context, sess);
+}
+
+
+// Write-behind mode. Startup-config is stored by background thread. The
+// 'synchronize' option waits for the write
+static int srp_commit_persist(kcontext_t *context, srp_persist_t *persist)
+{
+	if (!kpargv_find(kcontext_pargv(context), ARG_SYNCHRONIZE)) {
+		srp_persist_request(persist);
+		return 0;
+	}
+	if (!srp_persist_flush(persist)) {
+		fprintf(stderr, ERRORMSG "Can't store data to startup-config\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+// Incremental commit. Only the diff between candidate and running is
+// applied to running-config by edit batch. The same edit batch is applied to
+// startup-config only if startup-config is known to be equal to
+// running-config before commit. It's known when own last commit has written
+// startup-config and nobody else has changed running-config since then.
+// Else running-config is copied to startup-config entirely like
+// non-incremental commit does.
+static int srp_commit_diff(kcontext_t *context, sr_session_ctx_t *sess)
+{
+	int ret = -1;
+	struct lyd_node *diff = NULL;
+	struct lyd_node *edit = NULL;
+	srp_udata_t *udata = srp_udata(context);
+	bool_t startup_known = BOOL_FALSE;
+
+	startup_known = udata->startup_synced &&
+		srp_journal_is_valid(srp_udata_journal(context));
+	udata->startup_synced = BOOL_FALSE;
+
+	if (!srp_diff_get(sess, srp_udata_journal(context), NULL, NULL,
+		&diff)) {
+		srp_error(sess, ERRORMSG "Can't generate diff\n");
+		return -1;
+	}
+	// Nothing to commit
+	if (!diff)
+		return 0;
+	if (!srp_diff_edit(diff, &edit)) {
+		fprintf(stderr, ERRORMSG "Can't generate changes\n");
+		goto err;
+	}
 
-	// Validate candidate config
-	if (sr_validate(sess, NULL, 0) != SR_ERR_OK) {
-		srp_error(sess, ERRORMSG "Invalid candidate configuration\n");
+	// Apply changes to running-config
+	if (sr_session_switch_ds(sess, SR_DS_RUNNING)) {
+		srp_error(sess, ERRORMSG "Can't connect to running-config data store\n");
+		goto err;
+	}
+	if ((sr_edit_batch(sess, edit, "merge") != SR_ERR_OK) ||
+		(sr_apply_changes(sess, 0) != SR_ERR_OK)) {
+		sr_discard_changes(sess);
+		srp_error(sess, ERRORMSG "Can't commit to running-config\n");
+		goto err;
+	}
+
+	// Candidate is equal to running-config now. Reset it so it follows
+	// running-config like after copying. Copying running-config to
+	// candidate is a reset of candidate in sysrepo so data is not copied.
+	sr_session_switch_ds(sess, SRP_REPO_EDIT);
+	sr_copy_config(sess, NULL, SR_DS_RUNNING, 0);
+
+	if (srp_udata_persist(context)) {
+		ret = srp_commit_persist(context, srp_udata_persist(context));
+		goto err;
+	}
+
+	// Apply the same changes to startup-config. Startup-config is copied
+	// entirely when its baseline is unknown or changes can't be applied
+	if (sr_session_switch_ds(sess, SR_DS_STARTUP)) {
+		srp_error(sess, ERRORMSG "Can't connect to startup-config data store\n");
 		goto err;
 	}
+	if (!startup_known || (sr_edit_batch(sess, edit, "merge") != SR_ERR_OK) ||
+		(sr_apply_changes(sess, 0) != SR_ERR_OK)) {
+		sr_discard_changes(sess);
+		if (sr_copy_config(sess, NULL, SR_DS_RUNNING, 0) != SR_ERR_OK) {
+			srp_error(sess, ERRORMSG "Can't store data to startup-config\n");
+			goto err;
+		}
+	}
+	udata->startup_synced = BOOL_TRUE;
 
 	ret = 0;
 err:
+	lyd_free_siblings(edit);
+	lyd_free_siblings(diff);
+	sr_session_switch_ds(sess, SRP_REPO_EDIT);
 
 	return ret;
 }
@@ -812,21 +1109,30 @@ int srp_commit(kcontext_t *context)
 {
 	int ret = -1;
 	sr_session_ctx_t *sess = NULL;
+	unsigned int stamp = 0;
 
 	assert(context);
 	sess = srp_udata_sr_sess(context);
 	if (!sess)
 		return -1;
+	stamp = srp_journal_stamp(srp_udata_journal(context));
+	if (srp_apply_changes(context, sess) < 0)
+		return -1;
 
-	// Validate candidate config. The copy operation is not enough to fully
-	// verify candidate config. It verifies only the part of it. So verify
-	// before commit
-	if (sr_validate(sess, NULL, 0) != SR_ERR_OK) {
-		srp_error(sess, ERRORMSG "Invalid candidate configuration\n");
-		goto err;
+	// The edit batch of incremental commit is validated by sysrepo on
+	// applying to running-config. Changed modules and modules depending on
+	// them are validated so separate validation is not needed.
+	if (srp_udata_opts(context)->incremental_commit) {
+		ret = srp_commit_diff(context, sess);
+		if (0 == ret)
+			srp_journal_reset(srp_udata_journal(context), stamp);
+		return ret;
 	}
 
-	// Copy candidate to running-config
+	srp_udata(context)->startup_synced = BOOL_FALSE;
+
+	// Copy candidate to running-config. The sr_copy_config() validates
+	// the resulting running-config so separate validation is not needed
 	if (sr_session_switch_ds(sess, SR_DS_RUNNING)) {
 		srp_error(sess, ERRORMSG "Can't connect to running-config data store\n");
 		goto err;
@@ -835,6 +1141,12 @@ int srp_commit(kcontext_t *context)
 		srp_error(sess, ERRORMSG "Can't commit to running-config\n");
 		goto err;
 	}
+	srp_journal_reset(srp_udata_journal(context), stamp);
+
+	if (srp_udata_persist(context)) {
+		ret = srp_commit_persist(context, srp_udata_persist(context));
+		goto err;
+	}
 
 	// Copy running-config to startup-config
 	if (sr_session_switch_ds(sess, SR_DS_STARTUP)) {
@@ -845,6 +1157,7 @@ int srp_commit(kcontext_t *context)
 		srp_error(sess, ERRORMSG "Can't store data to startup-config\n");
 		goto err;
 	}
+	srp_udata(context)->startup_synced = BOOL_TRUE;
 
 	ret = 0;
 err:
@@ -858,17 +1171,24 @@ int srp_reset(kcontext_t *context)
 {
 	int ret = -1;
 	sr_session_ctx_t *sess = NULL;
+	unsigned int stamp = 0;
 
 	assert(context);
 	sess = srp_udata_sr_sess(context);
 	if (!sess)
 		return -1;
+	stamp = srp_journal_stamp(srp_udata_journal(context));
+
+	// Deferred edits are reset too
+	sr_discard_changes(sess);
+	srp_udata(context)->deferred_num = 0;
 
 	// Copy running-config to candidate config
 	if (sr_copy_config(sess, NULL, SR_DS_RUNNING, 0) != SR_ERR_OK) {
 		srp_error(sess, ERRORMSG "Can't reset to running-config\n");
 		goto err;
 	}
+	srp_journal_reset(srp_udata_journal(context), stamp);
 
 	ret = 0;
 err:
@@ -877,89 +1197,219 @@ err:
 }
 
 
-int srp_show_xml(kcontext_t *context)
+// Copy running-config to startup-config and wait for it. In write-behind
+// mode it's a barrier for background writes. The 'status' option shows
+// state of startup-config instead.
+int srp_save(kcontext_t *context)
 {
 	int ret = -1;
-	faux_argv_t *args = NULL;
-	pline_t *pline = NULL;
 	sr_session_ctx_t *sess = NULL;
-	pexpr_t *expr = NULL;
-	faux_argv_t *cur_path = NULL;
-	sr_data_t *data = NULL;
-	struct ly_out *out = NULL;
+	srp_persist_t *persist = NULL;
 
 	assert(context);
 	sess = srp_udata_sr_sess(context);
 	if (!sess)
 		return -1;
+	persist = srp_udata_persist(context);
+
+	if (kpargv_find(kcontext_pargv(context), ARG_STATUS)) {
+		bool_t pending = BOOL_FALSE;
+		bool_t failed = BOOL_FALSE;
+		const char *status = "synchronous";
+
+		if (persist) {
+			srp_persist_status(persist, &pending, &failed);
+			if (pending)
+				status = "pending";
+			else if (failed)
+				status = "failed";
+			else
+				status = "saved";
+		}
+		printf("Startup-config: %s\n", status);
+		return 0;
+	}
 
-	cur_path = (faux_argv_t *)srp_udata_path(context);
-	args = param2argv(cur_path, kcontext_pargv(context), ARG_PATH);
-	pline = pline_parse(sess, args, srp_udata_opts(context));
-	faux_argv_free(args);
-
-	if (pline->invalid) {
-		fprintf(stderr, ERRORMSG "Invalid 'show' request\n");
-		goto err;
+	if (persist) {
+		if (!srp_persist_flush(persist)) {
+			fprintf(stderr, ERRORMSG "Can't store data to startup-config\n");
+			return -1;
+		}
+		return 0;
 	}
 
-	if (faux_list_len(pline->exprs) > 1) {
-		fprintf(stderr, ERRORMSG "Can't process more than one object\n");
+	if (sr_session_switch_ds(sess, SR_DS_STARTUP)) {
+		srp_error(sess, ERRORMSG "Can't connect to startup-config data store\n");
 		goto err;
 	}
-
-	expr = (pexpr_t *)faux_list_data(faux_list_head(pline->exprs));
-	if (!(expr->pat & PT_EDIT)) {
-		fprintf(stderr, ERRORMSG "Illegal expression for 'show' operation\n");
+	if (sr_copy_config(sess, NULL, SR_DS_RUNNING, 0) != SR_ERR_OK) {
+		srp_error(sess, ERRORMSG "Can't store data to startup-config\n");
 		goto err;
 	}
 
-	if (sr_get_subtree(sess, expr->xpath, 0, &data) != SR_ERR_OK) {
-		srp_error(sess, ERRORMSG "Can't get specified subtree\n");
-		goto err;
+	ret = 0;
+err:
+	sr_session_switch_ds(sess, SRP_REPO_EDIT);
+
+	return ret;
+}
+
+
+// Start batch of deferred edits. Edits are applied by 'flush'
+int srp_begin(kcontext_t *context)
+{
+	assert(context);
+
+	srp_udata(context)->deferred = BOOL_TRUE;
+
+	return 0;
+}
+
+
+// Apply deferred edits and finish batch
+int srp_flush(kcontext_t *context)
+{
+	sr_session_ctx_t *sess = NULL;
+
+	assert(context);
+	sess = srp_udata_sr_sess(context);
+	if (!sess)
+		return -1;
+	srp_udata(context)->deferred = srp_udata_opts(context)->deferred_apply;
+
+	return srp_apply_changes(context, sess);
+}
+
+
+// Apply deferred edits. It's used before async symbols
+int srp_apply(kcontext_t *context)
+{
+	sr_session_ctx_t *sess = NULL;
+
+	assert(context);
+	sess = srp_udata_sr_sess(context);
+	if (!sess)
+		return -1;
+
+	return srp_apply_changes(context, sess);
+}
+
+
+// Filters are compiled after data fetching. Check expression beforehand so
+// the error is reported before any output
+static bool_t show_opts_regex(const char *regex, const char *name)
+{
+	regex_t re = {};
+
+	if (regcomp(&re, regex, REG_EXTENDED | REG_NOSUB) != 0) {
+		fprintf(stderr, ERRORMSG "Illegal '%s' expression\n", name);
+		return BOOL_FALSE;
 	}
-	if (!data) // Not found
-		goto err;
+	regfree(&re);
 
-	ly_out_new_file(stdout, &out);
-	lyd_print_tree(out, data->tree, LYD_XML, 0);
-	ly_out_free(out, NULL, 0);
-//	child = lyd_child(data->tree);
-//	if (child) {
-//		ly_out_new_file(stdout, &out);
-//		lyd_print_all(out, child, LYD_XML, 0);
-//	}
+	return BOOL_TRUE;
+}
 
-	struct lyd_meta *meta = lyd_find_meta(data->tree->meta, NULL, "junos-configuration-metadata:active");
-	if (meta)
-		printf("META\n");
 
-	sr_release_data(data);
+// Options of 'show' command. They override settings
+static bool_t show_opts(kcontext_t *context, pline_opts_t *opts)
+{
+	const kparg_t *parg = NULL;
 
-	ret = 0;
-err:
-	pline_free(pline);
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_DEPTH))) {
+		unsigned int depth = 0;
+		if (!faux_conv_atoui(kparg_value(parg), &depth, 10)) {
+			fprintf(stderr, ERRORMSG "Illegal depth value\n");
+			return BOOL_FALSE;
+		}
+		opts->show_depth = depth;
+	}
 
-	return ret;
+	if (kpargv_find(kcontext_pargv(context), ARG_DISPLAY_SET))
+		opts->show_display = SHOW_DISPLAY_SET;
+	else if (kpargv_find(kcontext_pargv(context), ARG_DISPLAY_XML))
+		opts->show_display = SHOW_DISPLAY_XML;
+	else if (kpargv_find(kcontext_pargv(context), ARG_DISPLAY_JSON))
+		opts->show_display = SHOW_DISPLAY_JSON;
+	else if (kpargv_find(kcontext_pargv(context), ARG_DISPLAY_LYB))
+		opts->show_display = SHOW_DISPLAY_LYB;
+
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_MATCH))) {
+		opts->show_match = kparg_value(parg);
+		if (!show_opts_regex(opts->show_match, "match"))
+			return BOOL_FALSE;
+	}
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_EXCEPT))) {
+		opts->show_except = kparg_value(parg);
+		if (!show_opts_regex(opts->show_except, "except"))
+			return BOOL_FALSE;
+	}
+	if (kpargv_find(kcontext_pargv(context), ARG_COUNT))
+		opts->show_count = BOOL_TRUE;
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_LAST))) {
+		unsigned int last = 0;
+		if (!faux_conv_atoui(kparg_value(parg), &last, 10) ||
+			(0 == last)) {
+			fprintf(stderr, ERRORMSG "Illegal 'last' value\n");
+			return BOOL_FALSE;
+		}
+		opts->show_last = last;
+	}
+
+	// Paging
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_FIRST))) {
+		unsigned int first = 0;
+		if (!faux_conv_atoui(kparg_value(parg), &first, 10) ||
+			(0 == first)) {
+			fprintf(stderr, ERRORMSG "Illegal 'first' value\n");
+			return BOOL_FALSE;
+		}
+		opts->show_first = first;
+	}
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_SKIP))) {
+		unsigned int skip = 0;
+		if (!faux_conv_atoui(kparg_value(parg), &skip, 10)) {
+			fprintf(stderr, ERRORMSG "Illegal 'skip' value\n");
+			return BOOL_FALSE;
+		}
+		opts->show_skip = skip;
+	}
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_FROM)))
+		opts->show_from = kparg_value(parg);
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_TO)))
+		opts->show_to = kparg_value(parg);
+
+	if (kpargv_find(kcontext_pargv(context), ARG_WITH_STATE))
+		opts->show_state = BOOL_TRUE;
+
+	return BOOL_TRUE;
 }
 
 
-static int show(kcontext_t *context, sr_datastore_t ds,
+static int show(kcontext_t *context, sr_session_ctx_t *sess,
+	volatile sig_atomic_t *cancel, sr_datastore_t ds,
 	const char *path_var, bool_t use_cur_path)
 {
 	int ret = -1;
 	faux_argv_t *args = NULL;
 	pline_t *pline = NULL;
-	sr_session_ctx_t *sess = NULL;
 	pexpr_t *expr = NULL;
 	faux_argv_t *cur_path = NULL;
 	char *xpath = NULL;
 	size_t xpath_depth = 0;
+	srp_sink_t *sink = NULL;
+	srp_cache_t *cache = NULL;
+	pline_opts_t opts = {};
 
 	assert(context);
-	sess = srp_udata_sr_sess(context);
-	if (!sess)
+	assert(sess);
+
+	opts = *srp_udata_opts(context);
+	if (!show_opts(context, &opts))
 		return -1;
+	// NACM view belongs to parent's connection
+	if (cancel)
+		opts.nacm = NULL;
 
 	if (ds != SRP_REPO_EDIT)
 		sr_session_switch_ds(sess, ds);
@@ -968,7 +1418,7 @@ static int show(kcontext_t *context, sr_datastore_t ds,
 
 	if (kpargv_find(kcontext_pargv(context), path_var) || cur_path) {
 		args = param2argv(cur_path, kcontext_pargv(context), path_var);
-		pline = pline_parse(sess, args, srp_udata_opts(context));
+		pline = pline_parse(sess, args, &opts);
 		faux_argv_free(args);
 
 		if (pline->invalid) {
@@ -997,7 +1447,33 @@ static int show(kcontext_t *context, sr_datastore_t ds,
 		xpath_depth = expr->tree_depth;
 	}
 
-	show_xpath(sess, xpath, xpath_depth, srp_udata_opts(context));
+	// Running datastore is shared so its rendered output can be cached
+	cache = srp_udata_cache(context);
+	if (cache && (SR_DS_RUNNING == ds)) {
+		bool_t failed = BOOL_FALSE;
+		fflush(stdout);
+		if (srp_cache_show(cache, sess, xpath, xpath_depth, &opts,
+			STDOUT_FILENO, &failed)) {
+			if (failed) {
+				srp_error(sess, NULL);
+				goto err;
+			}
+			ret = 0;
+			goto err;
+		}
+	}
+
+	sink = srp_sink_new(STDOUT_FILENO);
+	if (cancel)
+		srp_sink_set_cancel(sink, cancel);
+	if (!show_xpath(sess, xpath, xpath_depth, &opts, sink)) {
+		srp_sink_free(sink);
+		// Interrupted output is not an error
+		if (!(cancel && *cancel))
+			srp_error(sess, NULL);
+		goto err;
+	}
+	srp_sink_free(sink);
 
 	ret = 0;
 err:
@@ -1009,10 +1485,43 @@ err:
 }
 
 
-static int show_path(kcontext_t *context, bool_t use_cur_path)
+// Async show and diff are executed within forked process. The Ctrl-C
+// (SIGINT) and termination don't kill the process immediately but cancel
+// output. So fetching and rendering stop between chunks and connection is
+// closed properly. Closed pager makes output to fail with EPIPE that stops
+// rendering too.
+static volatile sig_atomic_t async_cancel = 0;
+
+
+static void async_sighandler(int signo)
+{
+	async_cancel = 1;
+	signo = signo; // Happy compiler
+}
+
+
+static void async_init_signals(void)
+{
+	struct sigaction sa = {};
+
+	async_cancel = 0;
+	sa.sa_handler = async_sighandler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+}
+
+
+static int show_path(kcontext_t *context, bool_t use_cur_path, bool_t async)
 {
 	sr_datastore_t ds = SRP_REPO_EDIT;
 	const char *script = NULL;
+	sr_session_ctx_t *sess = NULL;
+	srp_async_t conn = {};
+	int ret = -1;
 
 	assert(context);
 	script = kcontext_script(context);
@@ -1020,19 +1529,47 @@ static int show_path(kcontext_t *context, bool_t use_cur_path)
 		if (!kly_str2ds(script, strlen(script), &ds))
 			ds = SRP_REPO_EDIT;
 
-	return show(context, ds, ARG_PATH, use_cur_path);
+	if (!async) {
+		sess = srp_udata_sr_sess(context);
+		if (!sess)
+			return -1;
+		if (srp_apply_changes(context, sess) < 0)
+			return -1;
+		return show(context, sess, NULL, ds, ARG_PATH, use_cur_path);
+	}
+
+	async_init_signals();
+	if (!srp_async_connect(context, &conn))
+		return -1;
+	ret = show(context, conn.sr_sess, &async_cancel, ds, ARG_PATH,
+		use_cur_path);
+	srp_async_disconnect(&conn);
+
+	return ret;
 }
 
 
 int srp_show_abs(kcontext_t *context)
 {
-	return show_path(context, BOOL_FALSE);
+	return show_path(context, BOOL_FALSE, BOOL_FALSE);
 }
 
 
 int srp_show(kcontext_t *context)
 {
-	return show_path(context, BOOL_TRUE);
+	return show_path(context, BOOL_TRUE, BOOL_FALSE);
+}
+
+
+int srp_show_abs_async(kcontext_t *context)
+{
+	return show_path(context, BOOL_FALSE, BOOL_TRUE);
+}
+
+
+int srp_show_async(kcontext_t *context)
+{
+	return show_path(context, BOOL_TRUE, BOOL_TRUE);
 }
 
 
@@ -1051,6 +1588,8 @@ int srp_deactivate(kcontext_t *context)
 	sess = srp_udata_sr_sess(context);
 	if (!sess)
 		return -1;
+	if (srp_apply_changes(context, sess) < 0)
+		return -1;
 
 	cur_path = (faux_argv_t *)srp_udata_path(context);
 	args = param2argv(cur_path, kcontext_pargv(context), ARG_PATH);
@@ -1084,6 +1623,7 @@ int srp_deactivate(kcontext_t *context)
 		fprintf(stderr, ERRORMSG "Can't deactivate\n");
 		goto err;
 	}
+	srp_journal_add(srp_udata_journal(context), expr->xpath);
 
 	struct lyd_meta *meta = lyd_find_meta(data->tree->meta, NULL, "junos-configuration-metadata:active");
 	if (meta)
@@ -1120,22 +1660,33 @@ err:
 }
 
 
-int srp_diff(kcontext_t *context)
+static int show_diff(kcontext_t *context, sr_session_ctx_t *sess,
+	volatile sig_atomic_t *cancel)
 {
 	int ret = -1;
 	pline_t *pline = NULL;
-	sr_session_ctx_t *sess = NULL;
-	sr_data_t *data1 = NULL;
-	sr_data_t *data2 = NULL;
 	faux_argv_t *cur_path = NULL;
 	const char *xpath = NULL;
 	struct lyd_node *diff = NULL;
 	pline_opts_t masked_opts = {};
+	srp_sink_t *sink = NULL;
+	const kparg_t *parg = NULL;
+	const char *from = NULL;
+	const char *to = NULL;
+	bool_t res = BOOL_FALSE;
 
 	assert(context);
-	sess = srp_udata_sr_sess(context);
-	if (!sess)
+	assert(sess);
+
+	// Hack to don't show oneliners within diff. Mask oneliners flag
+	masked_opts = *srp_udata_opts(context);
+	masked_opts.oneliners = BOOL_FALSE;
+	if (!show_opts(context, &masked_opts))
 		return -1;
+	masked_opts.show_depth = 0;
+	// NACM view belongs to parent's connection
+	if (cancel)
+		masked_opts.nacm = NULL;
 
 	cur_path = (faux_argv_t *)srp_udata_path(context);
 
@@ -1144,7 +1695,7 @@ int srp_diff(kcontext_t *context)
 		pexpr_t *expr = NULL;
 
 		args = param2argv(cur_path, kcontext_pargv(context), ARG_PATH);
-		pline = pline_parse(sess, args, srp_udata_opts(context));
+		pline = pline_parse(sess, args, &masked_opts);
 		faux_argv_free(args);
 
 		if (pline->invalid) {
@@ -1172,42 +1723,42 @@ int srp_diff(kcontext_t *context)
 		xpath = expr->xpath;
 	}
 
-	if (!xpath)
-		xpath = "/*";
-
-	if (sr_get_data(sess, xpath, 0, 0, 0, &data2) != SR_ERR_OK) {
-		srp_error(sess, ERRORMSG "Can't get specified subtree\n");
-		goto err;
-	}
-
-	// Running config
-	sr_session_switch_ds(sess, SR_DS_RUNNING);
-
-	if (sr_get_data(sess, xpath, 0, 0, 0, &data1) != SR_ERR_OK) {
-		srp_error(sess, ERRORMSG "Can't get specified subtree\n");
+	// Datastores or snapshots to compare. Journal is for default ones only
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_DIFF_FROM)))
+		from = kparg_value(parg);
+	if ((parg = kpargv_find(kcontext_pargv(context), ARG_DIFF_TO)))
+		to = kparg_value(parg);
+	if ((from && !srp_diff_src_is_valid(from)) ||
+		(to && !srp_diff_src_is_valid(to))) {
+		fprintf(stderr, ERRORMSG "Unknown diff source '%s'\n",
+			(from && !srp_diff_src_is_valid(from)) ? from : to);
 		goto err;
 	}
-
-	if (lyd_diff_siblings(data1 ? data1->tree : NULL, data2 ? data2->tree : NULL,
-		0, &diff) != LY_SUCCESS) {
-		srp_error(sess, ERRORMSG "Can't generate diff\n");
+	if (from || to)
+		res = srp_diff_get_sources(sess, from, to, xpath, cancel, &diff);
+	else
+		res = srp_diff_get(sess, srp_udata_journal(context), xpath,
+			cancel, &diff);
+	if (!res) {
+		// Interrupted while fetching
+		if (!(cancel && *cancel))
+			srp_error(sess, ERRORMSG "Can't generate diff\n");
 		goto err;
 	}
 
-	// Hack to don't show oneliners within diff. Mask oneliners flag
-	masked_opts = *srp_udata_opts(context);
-	masked_opts.oneliners = BOOL_FALSE;
-
-	show_subtree(diff, 0, DIFF_OP_NONE, &masked_opts, BOOL_FALSE);
+	sink = srp_sink_new(STDOUT_FILENO);
+	if (cancel)
+		srp_sink_set_cancel(sink, cancel);
+	if (kpargv_find(kcontext_pargv(context), ARG_STAT))
+		show_diff_stat(diff, &masked_opts, sink);
+	else
+		show_subtree(diff, 0, DIFF_OP_NONE, &masked_opts, BOOL_FALSE,
+			sink);
+	srp_sink_free(sink);
 	lyd_free_siblings(diff);
 
 	ret = 0;
 err:
-	if (data1)
-		sr_release_data(data1);
-	if (data2)
-		sr_release_data(data2);
-
 	pline_free(pline);
 	sr_session_switch_ds(sess, SRP_REPO_EDIT);
 
@@ -1215,6 +1766,37 @@ err:
 }
 
 
+int srp_diff(kcontext_t *context)
+{
+	sr_session_ctx_t *sess = NULL;
+
+	assert(context);
+	sess = srp_udata_sr_sess(context);
+	if (!sess)
+		return -1;
+	if (srp_apply_changes(context, sess) < 0)
+		return -1;
+
+	return show_diff(context, sess, NULL);
+}
+
+
+int srp_diff_async(kcontext_t *context)
+{
+	srp_async_t conn = {};
+	int ret = -1;
+
+	assert(context);
+	async_init_signals();
+	if (!srp_async_connect(context, &conn))
+		return -1;
+	ret = show_diff(context, conn.sr_sess, &async_cancel);
+	srp_async_disconnect(&conn);
+
+	return ret;
+}
+
+
 int srp_compl_xpath(kcontext_t *context)
 {
 	sr_session_ctx_t *sess = NULL;
@@ -1224,30 +1806,40 @@ int srp_compl_xpath(kcontext_t *context)
 	const char *script = NULL;
 	const char *raw_xpath = NULL;
 	sr_datastore_t ds = SRP_REPO_EDIT;
+	sr_get_options_t get_opts = 0;
+	uint32_t timeout = 0;
+	pline_opts_t *opts = NULL;
+	srp_sink_t *sink = NULL;
 
 	assert(context);
 	script = kcontext_script(context);
 	if (faux_str_is_empty(script))
 		return -1;
 
-	if (!kly_parse_ext_xpath(script, &raw_xpath, &ds))
+	if (!kly_parse_ext_xpath(script, &raw_xpath, &ds, &get_opts, &timeout))
 		return -1;
 
 	sess = srp_udata_sr_sess(context);
 	if (!sess)
 		return -1;
+	opts = srp_udata_opts(context);
+	if (!timeout)
+		timeout = opts->compl_timeout;
 
 	if (ds != SRP_REPO_EDIT)
 		sr_session_switch_ds(sess, ds);
 
-	sr_get_items(sess, raw_xpath, 0, 0, &vals, &val_num);
+	kly_get_items(sess, raw_xpath, get_opts, timeout, opts->compl_latency,
+		&vals, &val_num);
+	sink = srp_sink_new(STDOUT_FILENO);
 	for (i = 0; i < val_num; i++) {
 		char *tmp = sr_val_to_str(&vals[i]);
 		if (!tmp)
 			continue;
-		printf("%s\n", tmp);
+		srp_sink_printf(sink, "%s\n", tmp);
 		free(tmp);
 	}
+	srp_sink_free(sink);
 	sr_free_values(vals, val_num);
 
 	if (ds != SRP_REPO_EDIT)
@@ -1258,6 +1850,210 @@ int srp_compl_xpath(kcontext_t *context)
 
 
 // Function for mass operations.
+// The line can begin with 'set', 'del' or 'insert' command like output of
+// 'show display set'. The command overrides default operation.
+static const char *srp_mass_line_op(const char *line, char *op)
+{
+	const char *p = line + strspn(line, " \t");
+	size_t len = strcspn(p, " \t");
+
+	if (!isspace((unsigned char)p[len]))
+		return line;
+	if ((3 == len) && (strncmp(p, "set", len) == 0))
+		*op = 's';
+	else if ((3 == len) && (strncmp(p, "del", len) == 0))
+		*op = 'd';
+	else if ((6 == len) && (strncmp(p, "insert", len) == 0))
+		*op = 'i';
+	else
+		return line;
+
+	return p + len;
+}
+
+
+static pline_t *srp_mass_parse(sr_session_ctx_t *sess,
+	const faux_argv_t *cur_path, const char *line, const pline_opts_t *opts)
+{
+	faux_argv_t *args = NULL;
+	pline_t *pline = NULL;
+
+	// Add current sysrepo path
+	if (cur_path)
+		args = faux_argv_dup(cur_path);
+	else
+		args = faux_argv_new();
+	faux_argv_parse(args, line);
+	pline = pline_parse(sess, args, opts);
+	faux_argv_free(args);
+
+	return pline;
+}
+
+
+// The whole line is parsed as path first so the path beginning with node
+// named 'set' or 'del' is not misparsed. The command prefix is stripped
+// only when the whole line is not a valid path.
+static pline_t *srp_mass_line_parse(sr_session_ctx_t *sess,
+	const faux_argv_t *cur_path, const char *line, const pline_opts_t *opts,
+	char *op)
+{
+	const char *rest = NULL;
+	char line_op = *op;
+	pline_t *pline = NULL;
+
+	rest = srp_mass_line_op(line, &line_op);
+	pline = srp_mass_parse(sess, cur_path, line, opts);
+	if ((rest == line) || (pline && !pline->invalid))
+		return pline;
+	pline_free(pline);
+	*op = line_op;
+
+	return srp_mass_parse(sess, cur_path, rest, opts);
+}
+
+
+// Arguments of path. The words from 'start' to 'end' are added to current
+// path
+static faux_argv_t *srp_mass_args(const faux_argv_t *cur_path,
+	const faux_argv_t *words, size_t start, size_t end)
+{
+	faux_argv_t *args = NULL;
+	faux_argv_node_t *iter = NULL;
+	const char *word = NULL;
+	size_t i = 0;
+
+	args = cur_path ? faux_argv_dup(cur_path) : faux_argv_new();
+	iter = faux_argv_iter(words);
+	while ((word = faux_argv_each(&iter))) {
+		if ((i >= start) && (i < end))
+			faux_argv_add(args, word);
+		i++;
+	}
+
+	return args;
+}
+
+
+static pexpr_t *srp_mass_insert_expr(pline_t *pline)
+{
+	pexpr_t *expr = NULL;
+
+	if (pline->invalid || (faux_list_len(pline->exprs) != 1))
+		return NULL;
+	expr = (pexpr_t *)faux_list_data(faux_list_head(pline->exprs));
+	if (!(expr->pat & PT_INSERT))
+		return NULL;
+
+	return expr;
+}
+
+
+// Move element. The 'pos' is index of position word. Returns BOOL_FALSE if
+// line can't be parsed with such position word.
+static bool_t srp_mass_move(sr_session_ctx_t *sess,
+	const faux_argv_t *cur_path, const faux_argv_t *words, size_t pos,
+	sr_move_position_t position, const pline_opts_t *opts, int *rc)
+{
+	faux_argv_t *args = NULL;
+	pline_t *pline = NULL;
+	pline_t *pline_to = NULL;
+	pexpr_t *expr = NULL;
+	pexpr_t *expr_to = NULL;
+	const char *list_keys = NULL;
+	const char *leaflist_value = NULL;
+	bool_t parsed = BOOL_FALSE;
+	size_t i = 0;
+
+	args = srp_mass_args(cur_path, words, 0, pos);
+	pline = pline_parse(sess, args, opts);
+	expr = srp_mass_insert_expr(pline);
+	if (!expr)
+		goto err;
+
+	// 'to' path is a list path of 'from' with another keys
+	if ((SR_MOVE_BEFORE == position) || (SR_MOVE_AFTER == position)) {
+		faux_argv_t *to_args = NULL;
+
+		for (i = 0; i < (expr->args_num - expr->list_pos); i++)
+			faux_argv_del(args, faux_argv_iterr(args));
+		to_args = srp_mass_args(args, words, pos + 1,
+			faux_argv_len(words));
+		pline_to = pline_parse(sess, to_args, opts);
+		faux_argv_free(to_args);
+		expr_to = srp_mass_insert_expr(pline_to);
+		if (!expr_to)
+			goto err;
+		if (PAT_LIST_KEY == expr_to->pat)
+			list_keys = expr_to->last_keys;
+		else // PATH_LEAFLIST_VALUE
+			leaflist_value = expr_to->last_keys;
+	}
+	parsed = BOOL_TRUE;
+
+	*rc = sr_move_item(sess, expr->xpath, position,
+		list_keys, leaflist_value, NULL, 0);
+err:
+	faux_argv_free(args);
+	pline_free(pline);
+	pline_free(pline_to);
+
+	return parsed;
+}
+
+
+// The 'insert' line is 'insert <kpath> <first/last/before/after> [to_key]'
+// like interactive 'insert' command. The position word can be a key value
+// too so each position word is tried until line is parsed.
+static int srp_mass_insert(sr_session_ctx_t *sess, const faux_argv_t *cur_path,
+	const char *line, const pline_opts_t *opts)
+{
+	faux_argv_t *words = NULL;
+	faux_argv_node_t *iter = NULL;
+	const char *word = NULL;
+	size_t words_num = 0;
+	size_t pos = 0;
+	int rc = SR_ERR_OK;
+	int ret = -1;
+
+	words = faux_argv_new();
+	faux_argv_parse(words, line);
+	words_num = faux_argv_len(words);
+	iter = faux_argv_iter(words);
+	for (pos = 0; (word = faux_argv_each(&iter)); pos++) {
+		sr_move_position_t position = SR_MOVE_LAST;
+		bool_t is_last = ((pos + 1) == words_num) ? BOOL_TRUE : BOOL_FALSE;
+
+		if (0 == pos)
+			continue;
+		if (is_last && (faux_str_cmp(word, "first") == 0))
+			position = SR_MOVE_FIRST;
+		else if (is_last && (faux_str_cmp(word, "last") == 0))
+			position = SR_MOVE_LAST;
+		else if (!is_last && (faux_str_cmp(word, "before") == 0))
+			position = SR_MOVE_BEFORE;
+		else if (!is_last && (faux_str_cmp(word, "after") == 0))
+			position = SR_MOVE_AFTER;
+		else
+			continue;
+		if (!srp_mass_move(sess, cur_path, words, pos, position, opts,
+			&rc))
+			continue;
+		if (rc != SR_ERR_OK) {
+			fprintf(stderr, "Error: Can't move element\n");
+			break;
+		}
+		ret = 0;
+		break;
+	}
+	if ((ret < 0) && (SR_ERR_OK == rc))
+		fprintf(stderr, "Error: Illegal: insert%s\n", line);
+	faux_argv_free(words);
+
+	return ret;
+}
+
+
 int srp_mass_op(char op, int fd, sr_datastore_t ds, const faux_argv_t *cur_path,
 	const pline_opts_t *opts, const char *user, bool_t stop_on_error)
 {
@@ -1299,24 +2095,25 @@ int srp_mass_op(char op, int fd, sr_datastore_t ds, const faux_argv_t *cur_path,
 
 	while ((line = faux_file_getline(file))) {
 		pline_t *pline = NULL;
-		faux_argv_t *args = NULL;
+		char line_op = op;
 
-		// Don't process empty strings and strings with only spaces
-		if (!faux_str_has_content(line)) {
+		// Don't process empty strings and strings with only spaces.
+		// Commented lines (like hidden passwords of 'show display set')
+		// are skipped too.
+		if (!faux_str_has_content(line) ||
+			('#' == line[strspn(line, " \t")])) {
 			faux_str_free(line);
 			continue;
 		}
 
-		// Add current sysrepo path
-		if (cur_path)
-			args = faux_argv_dup(cur_path);
-		else
-			args = faux_argv_new();
-
-		faux_argv_parse(args, line);
-		pline = pline_parse(sess, args, opts);
-		faux_argv_free(args);
-		if (!pline || pline->invalid) {
+		pline = srp_mass_line_parse(sess, cur_path, line, opts,
+			&line_op);
+		if ('i' == line_op) {
+			char insert_op = line_op;
+			if (srp_mass_insert(sess, cur_path,
+				srp_mass_line_op(line, &insert_op), opts) < 0)
+				err_num++;
+		} else if (!pline || pline->invalid) {
 			err_num++;
 			fprintf(stderr, "Error: Illegal: %s\n", line);
 		} else {
@@ -1326,7 +2123,7 @@ int srp_mass_op(char op, int fd, sr_datastore_t ds, const faux_argv_t *cur_path,
 			iter = faux_list_head(pline->exprs);
 			while ((expr = (pexpr_t *)faux_list_each(&iter))) {
 				// Set
-				if (op == 's') {
+				if (line_op == 's') {
 					if (!(expr->pat & PT_SET)) {
 						err_num++;
 						fprintf(stderr, "Error: Illegal expression"
@@ -1340,7 +2137,7 @@ int srp_mass_op(char op, int fd, sr_datastore_t ds, const faux_argv_t *cur_path,
 						break;
 					}
 				// Del
-				} else if (op == 'd') {
+				} else if (line_op == 'd') {
 					if (!(expr->pat & PT_DEL)) {
 						err_num++;
 						fprintf(stderr, "Error: Illegal expression"
@@ -1356,7 +2153,7 @@ int srp_mass_op(char op, int fd, sr_datastore_t ds, const faux_argv_t *cur_path,
 				} else {
 					err_num++;
 					fprintf(stderr, "Error: Illegal operation '%c'\n",
-						op);
+						line_op);
 					break;
 				}
 			}
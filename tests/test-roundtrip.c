@@ -0,0 +1,382 @@
+/** @file test-roundtrip.c
+ * @brief Round-trip tests of renderers.
+ *
+ * The output of renderers must be loadable back. The tests use temporary
+ * sysrepo repository with 'srp-test' module so they don't touch system
+ * configuration. The tests are:
+ *
+ * - 'show display set' output loaded by srp_mass_set() into empty
+ * candidate gives the same data (including order of user-ordered lists).
+ * - The edit generated by srp_diff_edit() from candidate vs running diff
+ * makes running equal to candidate.
+ * - Chunked and unchunked 'show' produce the same output.
+ *
+ * The test is skipped (exit code 77) if sysrepo can't be initialized.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+#include "klish_plugin_sysrepo.h"
+
+#define TEST_SKIP 77
+#define TEST_MODULE "srp-test"
+#define TEST_XPATH "/" TEST_MODULE ":*"
+
+
+static char test_repo[] = "/tmp/srp-test-XXXXXX";
+static char *test_shm_prefix = NULL;
+
+
+static void test_rm(const char *path)
+{
+	DIR *dir = NULL;
+	struct dirent *entry = NULL;
+	struct stat st = {};
+
+	if (lstat(path, &st) < 0)
+		return;
+	if (!S_ISDIR(st.st_mode)) {
+		unlink(path);
+		return;
+	}
+
+	dir = opendir(path);
+	while (dir && (entry = readdir(dir))) {
+		char *child = NULL;
+		if ((strcmp(entry->d_name, ".") == 0) ||
+			(strcmp(entry->d_name, "..") == 0))
+			continue;
+		child = faux_str_sprintf("%s/%s", path, entry->d_name);
+		test_rm(child);
+		faux_str_free(child);
+	}
+	if (dir)
+		closedir(dir);
+	rmdir(path);
+}
+
+
+static void test_env_free(void)
+{
+	glob_t gl = {};
+	char *pattern = NULL;
+	size_t i = 0;
+
+	if (!test_shm_prefix) // Repository is not created
+		return;
+	test_rm(test_repo);
+	// Sysrepo doesn't remove shared memory files on disconnect
+	pattern = faux_str_sprintf("/dev/shm/%s*", test_shm_prefix);
+	if (glob(pattern, 0, NULL, &gl) == 0) {
+		for (i = 0; i < gl.gl_pathc; i++)
+			unlink(gl.gl_pathv[i]);
+	}
+	globfree(&gl);
+	faux_str_free(pattern);
+	faux_str_free(test_shm_prefix);
+}
+
+
+// Sysrepo reads environment on the first connection
+static bool_t test_env_init(sr_conn_ctx_t **conn)
+{
+	if (!mkdtemp(test_repo))
+		return BOOL_FALSE;
+	test_shm_prefix = faux_str_sprintf("srp_test_%d", (int)getpid());
+	setenv("SYSREPO_REPOSITORY_PATH", test_repo, 1);
+	setenv("SYSREPO_SHM_PREFIX", test_shm_prefix, 1);
+
+	if (sr_connect(SR_CONN_DEFAULT, conn) != SR_ERR_OK)
+		return BOOL_FALSE;
+	if (sr_install_module(*conn, TEST_SRCDIR "/yang/klish.yang",
+		NULL, NULL) != SR_ERR_OK)
+		return BOOL_FALSE;
+	if (sr_install_module(*conn, TEST_SRCDIR "/tests/" TEST_MODULE ".yang",
+		TEST_SRCDIR "/yang", NULL) != SR_ERR_OK)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// Running config with user-ordered entries in not creation order and
+// list long enough to be chunked
+static bool_t test_data_init(sr_session_ctx_t *sess)
+{
+	const char *items[][2] = {
+		{"/srp-test:topleaf", "top value"},
+		{"/srp-test:test/iface[name='eth0']/comment", "First iface"},
+		{"/srp-test:test/iface[name='eth0']/multi", "m1"},
+		{"/srp-test:test/iface[name='eth0']/multi", "m2"},
+		{"/srp-test:test/iface[name='eth0']/secret", "pass word"},
+		{"/srp-test:test/iface[name='eth1']/comment", "Quoted \"desc\""},
+		{"/srp-test:test/iface[name='eth2']", NULL},
+		{"/srp-test:test/iface[name='eth3']", NULL},
+		{"/srp-test:test/iface[name='eth4']", NULL},
+		{"/srp-test:acl[name='a1']/comment", "acl one"},
+		{"/srp-test:acl[name='a2']/multi", "x"},
+		{"/srp-test:acl[name='a2']/multi", "y"},
+		{"/srp-test:acl[name='a3']", NULL},
+		{"/srp-test:rule[from='r1'][to='r2']/comment", "rule"},
+		{NULL, NULL}
+	};
+	size_t i = 0;
+
+	for (i = 0; items[i][0]; i++) {
+		if (sr_set_item_str(sess, items[i][0], items[i][1], NULL, 0) !=
+			SR_ERR_OK)
+			return BOOL_FALSE;
+	}
+	if (sr_move_item(sess, "/srp-test:acl[name='a3']", SR_MOVE_FIRST,
+		NULL, NULL, NULL, 0) != SR_ERR_OK)
+		return BOOL_FALSE;
+	if (sr_move_item(sess, "/srp-test:acl[name='a2']/multi[.='y']",
+		SR_MOVE_FIRST, NULL, NULL, NULL, 0) != SR_ERR_OK)
+		return BOOL_FALSE;
+
+	return (sr_apply_changes(sess, 0) == SR_ERR_OK);
+}
+
+
+static char *test_render(sr_session_ctx_t *sess, const char *xpath,
+	pline_opts_t *opts)
+{
+	srp_sink_t *sink = NULL;
+	const char *data = NULL;
+	size_t len = 0;
+	char *out = NULL;
+
+	sink = srp_sink_new_mem();
+	if (show_xpath(sess, xpath, 0, opts, sink)) {
+		data = srp_sink_data(sink, &len);
+		out = faux_str_dupn(data, len);
+	}
+	srp_sink_free(sink);
+
+	return out;
+}
+
+
+// Test module data of both datastores are equal including order
+static bool_t test_ds_equal(sr_session_ctx_t *sess,
+	sr_datastore_t first, sr_datastore_t second)
+{
+	sr_data_t *data1 = NULL;
+	sr_data_t *data2 = NULL;
+	bool_t ret = BOOL_FALSE;
+
+	sr_session_switch_ds(sess, first);
+	if (sr_get_data(sess, TEST_XPATH, 0, 0, 0, &data1) != SR_ERR_OK)
+		goto err;
+	sr_session_switch_ds(sess, second);
+	if (sr_get_data(sess, TEST_XPATH, 0, 0, 0, &data2) != SR_ERR_OK)
+		goto err;
+	if (!data1 || !data2) {
+		ret = (!data1 && !data2);
+		goto err;
+	}
+	ret = (lyd_compare_siblings(data1->tree, data2->tree,
+		LYD_COMPARE_FULL_RECURSION) == LY_SUCCESS);
+err:
+	sr_release_data(data1);
+	sr_release_data(data2);
+
+	return ret;
+}
+
+
+static bool_t test_display_set(sr_session_ctx_t *sess, pline_opts_t *opts)
+{
+	pline_opts_t set_opts = *opts;
+	char *out = NULL;
+	char fn[] = "/tmp/srp-test-set-XXXXXX";
+	int fd = -1;
+	bool_t ret = BOOL_FALSE;
+
+	set_opts.show_display = SHOW_DISPLAY_SET;
+	sr_session_switch_ds(sess, SR_DS_RUNNING);
+	out = test_render(sess, TEST_XPATH, &set_opts);
+	if (faux_str_is_empty(out))
+		goto err;
+
+	fd = mkstemp(fn);
+	if (fd < 0)
+		goto err;
+	unlink(fn);
+	if (write(fd, out, strlen(out)) != (ssize_t)strlen(out))
+		goto err;
+	lseek(fd, 0, SEEK_SET);
+
+	// Load output into empty candidate
+	sr_session_switch_ds(sess, SR_DS_CANDIDATE);
+	if (sr_replace_config(sess, TEST_MODULE, NULL, 0) != SR_ERR_OK)
+		goto err;
+	// Mass operation closes descriptor
+	if (srp_mass_set(fd, SR_DS_CANDIDATE, NULL, opts, "root",
+		BOOL_TRUE) < 0) {
+		fd = -1;
+		goto err;
+	}
+	fd = -1;
+
+	ret = test_ds_equal(sess, SR_DS_RUNNING, SR_DS_CANDIDATE);
+err:
+	if (fd >= 0)
+		close(fd);
+	if (!ret)
+		fprintf(stderr, "display set output:\n%s\n", out ? out : "");
+	faux_str_free(out);
+
+	return ret;
+}
+
+
+static bool_t test_diff_edit(sr_session_ctx_t *sess)
+{
+	const char *sets[][2] = {
+		{"/srp-test:test/iface[name='eth5']/comment", "New iface"},
+		{"/srp-test:test/iface[name='eth0']/comment", "Changed"},
+		{"/srp-test:test/shutdown", NULL},
+		{"/srp-test:acl[name='a4']", NULL},
+		{NULL, NULL}
+	};
+	const char *dels[] = {
+		"/srp-test:rule[from='r1'][to='r2']",
+		"/srp-test:test/iface[name='eth0']/multi[.='m1']",
+		"/srp-test:topleaf",
+		NULL
+	};
+	struct lyd_node *diff = NULL;
+	struct lyd_node *edit = NULL;
+	size_t i = 0;
+	bool_t ret = BOOL_FALSE;
+
+	sr_session_switch_ds(sess, SR_DS_CANDIDATE);
+	if (sr_copy_config(sess, TEST_MODULE, SR_DS_RUNNING, 0) != SR_ERR_OK)
+		goto err;
+	for (i = 0; sets[i][0]; i++) {
+		if (sr_set_item_str(sess, sets[i][0], sets[i][1], NULL, 0) !=
+			SR_ERR_OK)
+			goto err;
+	}
+	for (i = 0; dels[i]; i++) {
+		if (sr_delete_item(sess, dels[i], 0) != SR_ERR_OK)
+			goto err;
+	}
+	if (sr_move_item(sess, "/srp-test:acl[name='a1']", SR_MOVE_AFTER,
+		"[name='a2']", NULL, NULL, 0) != SR_ERR_OK)
+		goto err;
+	if (sr_move_item(sess, "/srp-test:acl[name='a2']/multi[.='x']",
+		SR_MOVE_FIRST, NULL, NULL, NULL, 0) != SR_ERR_OK)
+		goto err;
+	if (sr_apply_changes(sess, 0) != SR_ERR_OK)
+		goto err;
+
+	if (!srp_diff_get(sess, NULL, NULL, NULL, &diff) || !diff)
+		goto err;
+	if (!srp_diff_edit(diff, &edit) || !edit)
+		goto err;
+
+	// The same way as incremental commit does
+	sr_session_switch_ds(sess, SR_DS_RUNNING);
+	if ((sr_edit_batch(sess, edit, "merge") != SR_ERR_OK) ||
+		(sr_apply_changes(sess, 0) != SR_ERR_OK)) {
+		sr_discard_changes(sess);
+		goto err;
+	}
+
+	ret = test_ds_equal(sess, SR_DS_RUNNING, SR_DS_CANDIDATE);
+err:
+	lyd_free_siblings(diff);
+	lyd_free_siblings(edit);
+
+	return ret;
+}
+
+
+static bool_t test_chunked(sr_session_ctx_t *sess, pline_opts_t *opts)
+{
+	pline_opts_t chunk_opts = *opts;
+	char *whole = NULL;
+	char *chunked = NULL;
+	bool_t ret = BOOL_FALSE;
+
+	sr_session_switch_ds(sess, SR_DS_RUNNING);
+	chunk_opts.show_chunk = 0;
+	whole = test_render(sess, NULL, &chunk_opts);
+	chunk_opts.show_chunk = 2;
+	chunked = test_render(sess, NULL, &chunk_opts);
+	if (!whole || !chunked)
+		goto err;
+
+	ret = (faux_str_cmp(whole, chunked) == 0);
+	if (!ret)
+		fprintf(stderr, "Unchunked:\n%s\nChunked:\n%s\n",
+			whole, chunked);
+err:
+	faux_str_free(whole);
+	faux_str_free(chunked);
+
+	return ret;
+}
+
+
+int main(void)
+{
+	int ret = TEST_SKIP;
+	sr_conn_ctx_t *conn = NULL;
+	sr_session_ctx_t *sess = NULL;
+	pline_opts_t opts = {};
+	size_t failed = 0;
+
+	ly_log_level(LY_LLERR);
+
+	if (!test_env_init(&conn)) {
+		fprintf(stderr, "Can't init sysrepo. Skipped\n");
+		goto out;
+	}
+	if (sr_session_start(conn, SR_DS_RUNNING, &sess) != SR_ERR_OK)
+		goto out;
+	ret = -1;
+	if (!test_data_init(sess)) {
+		fprintf(stderr, "Can't init data\n");
+		goto out;
+	}
+
+	pline_opts_init(&opts);
+	opts.hide_passwords = BOOL_FALSE;
+
+	// Chunked output is compared against the initial data before other
+	// tests change running
+	if (!test_chunked(sess, &opts)) {
+		fprintf(stderr, "FAIL: chunked output\n");
+		failed++;
+	}
+	if (!test_display_set(sess, &opts)) {
+		fprintf(stderr, "FAIL: display set round-trip\n");
+		failed++;
+	}
+	if (!test_diff_edit(sess)) {
+		fprintf(stderr, "FAIL: diff edit round-trip\n");
+		failed++;
+	}
+
+	ret = (failed > 0) ? -1 : 0;
+out:
+	sr_disconnect(conn);
+	test_env_free();
+
+	return (ret < 0) ? EXIT_FAILURE : ret;
+}